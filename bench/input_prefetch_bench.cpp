@@ -0,0 +1,195 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sam_reader.h"
+#include "input_prefetcher.h"
+
+
+typedef std::chrono::steady_clock BenchClock;
+
+
+double elapsedMs(const BenchClock::time_point &start)
+{
+    return std::chrono::duration< double, std::milli >(BenchClock::now() - start).count();
+}
+
+
+// Small single-end SAM file: header plus num_reads 100 bp reads at random positions of one contig
+void writeSam(const std::string &path, const int &num_reads, std::mt19937_64 &rng)
+{
+    const char bases[] = "ACGT";
+    std::uniform_int_distribution< long > pos_dist(1, 900000);
+    std::ofstream ofs(path);
+    ofs << "@HD\tVN:1.6\tSO:unsorted\n@SQ\tSN:chr1\tLN:1000000\n";
+    std::string seq(100, 'A');
+    std::string qual(100, 'I');
+    for(int r = 0; r < num_reads; ++r) {
+        for(char &c : seq) {
+            c = bases[rng() & 3];
+        }
+        ofs << "read" << r << "\t0\tchr1\t" << pos_dist(rng) << "\t60\t100M\t*\t0\t0\t" << seq << '\t' << qual << '\n';
+    }
+}
+
+
+// Lean per-file reader: one open, fstat and pread of the whole file on the parser thread, the least a parser can do
+// without a prefetcher
+bool preadFile(const std::string &path, std::vector< char > &contents)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat sb;
+    bool success = (fstat(fd, &sb) == 0);
+    contents.resize(success ? sb.st_size : 0);
+    long done = 0;
+    while(success && (done < (long)contents.size())) {
+        ssize_t n = pread(fd, contents.data() + done, contents.size() - done, done);
+        success = (n > 0);
+        done += success ? n : 0;
+    }
+    close(fd);
+    return success;
+}
+
+
+// Parse every file on num_threads threads pulling from a shared index, as the job dispatcher does; returns the
+// number of lines read so the work cannot be optimized away.  Files are taken from the prefetcher if given, else
+// read whole with preadFile() if per_file_pread, else streamed by SamReader.
+long readAll(const std::vector< std::string > &files,
+             const int &num_threads,
+             InputPrefetcher* prefetcher,
+             const bool &per_file_pread)
+{
+    std::atomic< int > next_file(0);
+    std::atomic< long > total_lines(0);
+    std::vector< std::thread > workers;
+    for(int t = 0; t < num_threads; ++t) {
+        workers.emplace_back([&] () {
+            std::string line;
+            int i;
+            while((i = next_file++) < (int)files.size()) {
+                std::unique_ptr< SamReader > reader;
+                std::vector< char > contents;
+                if(((prefetcher != nullptr) && prefetcher->take(files[i], contents))
+                   || (per_file_pread && preadFile(files[i], contents))) {
+                    reader = std::make_unique< SamReader >(files[i], 4, SamReader::block_bytes, std::move(contents));
+                }
+                else {
+                    reader = std::make_unique< SamReader >(files[i], 4, SamReader::block_bytes);
+                }
+                long lines = 0;
+                while(reader->getline(line)) {
+                    lines++;
+                }
+                total_lines += lines;
+            }
+        });
+    }
+    for(std::thread &worker : workers) {
+        worker.join();
+    }
+    return total_lines;
+}
+
+
+int main(int argc, const char *argv[])
+{
+    int num_files = 1000;
+    int reads_per_file = 200;
+    int num_threads = 4;
+    if(argc > 1) {
+        num_files = std::stoi(argv[1]);
+    }
+    if(argc > 2) {
+        reads_per_file = std::stoi(argv[2]);
+    }
+    if(argc > 3) {
+        num_threads = std::stoi(argv[3]);
+    }
+
+    std::string dir = std::filesystem::temp_directory_path().string() + "/input_prefetch_bench_" +
+                      std::to_string(getpid());
+    std::filesystem::create_directories(dir);
+    std::mt19937_64 rng(42);
+    std::vector< std::string > files;
+    for(int i = 0; i < num_files; ++i) {
+        files.push_back(dir + "/S" + std::to_string(i) + ".sam");
+        writeSam(files.back(), reads_per_file, rng);
+    }
+
+    // Files are in the page cache after writing, so this measures syscall and thread overhead, not the disk.  The
+    // modes are interleaved over several rounds and each keeps its best time, so one-off noise does not decide.
+    const int num_rounds = 5;
+    double direct_ms = 0;
+    double per_file_ms = 0;
+    double pread_ms = 0;
+    double uring_ms = 0;
+    long direct_lines = 0;
+    long per_file_lines = 0;
+    long pread_lines = 0;
+    long uring_lines = 0;
+    bool uring_used = false;
+    for(int round = 0; round < num_rounds; ++round) {
+        BenchClock::time_point t0 = BenchClock::now();
+        direct_lines = readAll(files, num_threads, nullptr, false);
+        double ms = elapsedMs(t0);
+        direct_ms = (round == 0) ? ms : std::min(direct_ms, ms);
+
+        t0 = BenchClock::now();
+        per_file_lines = readAll(files, num_threads, nullptr, true);
+        ms = elapsedMs(t0);
+        per_file_ms = (round == 0) ? ms : std::min(per_file_ms, ms);
+
+        t0 = BenchClock::now();
+        {
+            InputPrefetcher prefetcher(files, 2 * num_threads, 1L << 24, false);
+            pread_lines = readAll(files, num_threads, &prefetcher, false);
+        }
+        ms = elapsedMs(t0);
+        pread_ms = (round == 0) ? ms : std::min(pread_ms, ms);
+
+        t0 = BenchClock::now();
+        {
+            InputPrefetcher prefetcher(files, 2 * num_threads, 1L << 24, true);
+            uring_used = prefetcher.usingUring();
+            uring_lines = readAll(files, num_threads, &prefetcher, false);
+        }
+        ms = elapsedMs(t0);
+        uring_ms = (round == 0) ? ms : std::min(uring_ms, ms);
+    }
+
+    std::filesystem::remove_all(dir);
+
+    std::cout << num_files << " SAM files x " << reads_per_file << " reads, " << num_threads << " parser threads, best";
+    std::cout << " of " << num_rounds << " rounds" << std::endl;
+    std::cout << "SamReader per file:      " << direct_ms << " ms, " << (num_files / direct_ms * 1000) << " files/s";
+    std::cout << " (" << direct_lines << " lines)" << std::endl;
+    std::cout << "pread per file:          " << per_file_ms << " ms, " << (num_files / per_file_ms * 1000);
+    std::cout << " files/s (" << per_file_lines << " lines)" << std::endl;
+    std::cout << "Prefetch (pread):        " << pread_ms << " ms, " << (num_files / pread_ms * 1000) << " files/s";
+    std::cout << " (" << pread_lines << " lines)" << std::endl;
+    std::cout << "Prefetch (io_uring" << (uring_used ? "" : " unavailable, pread") << "): " << uring_ms << " ms, ";
+    std::cout << (num_files / uring_ms * 1000) << " files/s (" << uring_lines << " lines)" << std::endl;
+    // Positive when io_uring beats pread
+    std::cout << "io_uring vs pread prefetch: " << (100 * (pread_ms - uring_ms) / pread_ms) << "%, vs pread per file: ";
+    std::cout << (100 * (per_file_ms - uring_ms) / per_file_ms) << "%" << std::endl;
+
+    if((per_file_lines != direct_lines) || (pread_lines != direct_lines) || (uring_lines != direct_lines)) {
+        std::cerr << "ERROR: Readers returned different line counts" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include "IntervalTree.h"
+#include "FlatIntervalTree.h"
+
+
+typedef IntervalTree<long, int> ITree;
+typedef FlatIntervalTree<long, int> FlatITree;
+typedef std::chrono::steady_clock BenchClock;
+typedef std::tuple< long, long, int > Hit;
+
+
+double elapsedMs(const BenchClock::time_point &start)
+{
+    return std::chrono::duration< double, std::milli >(BenchClock::now() - start).count();
+}
+
+
+// Sorted (start, stop, value) set of the intervals overlapping one query
+template <class Tree>
+void hitSet(const Tree &tree, const std::pair< long, long > &query, std::vector< Hit > &hits)
+{
+    hits.clear();
+    tree.visit_overlapping(query.first, query.second, [&](const typename Tree::interval &ival) {
+        hits.emplace_back(ival.start, ival.stop, ival.value);
+    });
+    std::sort(hits.begin(), hits.end());
+}
+
+
+int main(int argc, const char *argv[])
+{
+    long num_intervals = 1000000;
+    long num_queries = 1000000;
+    long genome_len = 100000000;
+    if(argc > 1) {
+        num_intervals = std::stol(argv[1]);
+    }
+    if(argc > 2) {
+        num_queries = std::stol(argv[2]);
+    }
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution< long > pos_dist(0, genome_len);
+    std::uniform_int_distribution< long > len_dist(1, 5000);
+
+    ITree::interval_vector ivals;
+    for(long i = 0; i < num_intervals; ++i) {
+        long start = pos_dist(rng);
+        ivals.push_back(ITree::interval(start, start + len_dist(rng), (int)i));
+    }
+    std::vector< std::pair< long, long > > queries;
+    for(long i = 0; i < num_queries; ++i) {
+        long start = pos_dist(rng);
+        queries.push_back(std::make_pair(start, start + len_dist(rng)));
+    }
+
+    ITree::interval_vector ivals_copy = ivals;
+    BenchClock::time_point t0 = BenchClock::now();
+    ITree tree(std::move(ivals_copy));
+    double tree_build = elapsedMs(t0);
+
+    ivals_copy = ivals;
+    t0 = BenchClock::now();
+    FlatITree flat_tree(std::move(ivals_copy));
+    double flat_build = elapsedMs(t0);
+
+    long tree_hits = 0;
+    t0 = BenchClock::now();
+    for(long i = 0; i < num_queries; ++i) {
+        tree.visit_overlapping(queries[i].first, queries[i].second, [&](const ITree::interval &) { tree_hits++; });
+    }
+    double tree_query = elapsedMs(t0);
+
+    long flat_hits = 0;
+    t0 = BenchClock::now();
+    for(long i = 0; i < num_queries; ++i) {
+        flat_tree.visit_overlapping(queries[i].first, queries[i].second, [&](const FlatITree::interval &) {
+            flat_hits++;
+        });
+    }
+    double flat_query = elapsedMs(t0);
+
+    std::sort(queries.begin(), queries.end());
+    long sorted_tree_hits = 0;
+    t0 = BenchClock::now();
+    for(long i = 0; i < num_queries; ++i) {
+        tree.visit_overlapping(queries[i].first, queries[i].second, [&](const ITree::interval &) {
+            sorted_tree_hits++;
+        });
+    }
+    double sorted_tree_query = elapsedMs(t0);
+
+    long batch_hits = 0;
+    t0 = BenchClock::now();
+    flat_tree.visit_overlapping_sorted(queries, [&](std::size_t, const FlatITree::interval &) { batch_hits++; });
+    double batch_query = elapsedMs(t0);
+
+    std::cout << "Intervals: " << num_intervals << "\tQueries: " << num_queries << std::endl;
+    std::cout << "IntervalTree build (ms):\t" << tree_build << std::endl;
+    std::cout << "FlatIntervalTree build (ms):\t" << flat_build << std::endl;
+    std::cout << "IntervalTree random queries (ms):\t" << tree_query << "\thits: " << tree_hits << std::endl;
+    std::cout << "FlatIntervalTree random queries (ms):\t" << flat_query << "\thits: " << flat_hits << std::endl;
+    std::cout << "IntervalTree sorted queries (ms):\t" << sorted_tree_query << "\thits: " << sorted_tree_hits;
+    std::cout << std::endl;
+    std::cout << "FlatIntervalTree sorted batch (ms):\t" << batch_query << "\thits: " << batch_hits << std::endl;
+
+    // Equal hit counts could still hide a wrong interval returned in place of a right one, so each query's hits
+    // are compared as sets against IntervalTree, outside the timed loops
+    long mismatched_queries = 0;
+    std::vector< Hit > expected;
+    std::vector< Hit > actual;
+    for(long i = 0; i < num_queries; ++i) {
+        hitSet(tree, queries[i], expected);
+        hitSet(flat_tree, queries[i], actual);
+        if(actual != expected) {
+            mismatched_queries++;
+        }
+    }
+
+    // The batch visits queries in order, so each query's hits are complete once a later query index shows up
+    long batch_mismatched_queries = 0;
+    std::size_t current = 0;
+    actual.clear();
+    auto checkBatchQuery = [&]() {
+        std::sort(actual.begin(), actual.end());
+        hitSet(tree, queries[current], expected);
+        if(actual != expected) {
+            batch_mismatched_queries++;
+        }
+        actual.clear();
+        current++;
+    };
+    flat_tree.visit_overlapping_sorted(queries, [&](std::size_t q, const FlatITree::interval &ival) {
+        while(current < q) {
+            checkBatchQuery();
+        }
+        actual.emplace_back(ival.start, ival.stop, ival.value);
+    });
+    while(current < queries.size()) {
+        checkBatchQuery();
+    }
+
+    if((tree_hits != flat_hits) || (sorted_tree_hits != batch_hits) || (mismatched_queries > 0)
+       || (batch_mismatched_queries > 0)) {
+        std::cerr << "ERROR: Interval tree results differ (queries with different hits: " << mismatched_queries;
+        std::cerr << " random, " << batch_mismatched_queries << " sorted batch)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
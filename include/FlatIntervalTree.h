@@ -0,0 +1,235 @@
+#ifndef __FLAT_INTERVAL_TREE_H
+#define __FLAT_INTERVAL_TREE_H
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+#include <limits>
+#include <utility>
+#include "IntervalTree.h"
+
+#ifdef USE_INTERVAL_TREE_NAMESPACE
+namespace interval_tree {
+#endif
+// Implicit (array-backed) augmented interval tree.
+//
+// Intervals are kept sorted by start in one contiguous vector and the tree is implied by the array index: leaves
+// sit at even indices, and a node at level k has index i with its low k bits set and bit k clear, so the root of
+// a tree of max_level L is (1 << L) - 1.  Each node stores the maximum stop of its subtree in a parallel vector.
+// Queries walk the implicit tree with a small explicit stack and scan leaves linearly once a subtree is small,
+// so there are no pointer chases and no per-node heap allocations.  Query results are identical to IntervalTree.
+template <class Scalar, class Value>
+class FlatIntervalTree {
+public:
+    typedef Interval<Scalar, Value> interval;
+    typedef std::vector<interval> interval_vector;
+    typedef std::pair<Scalar, Scalar> query;
+
+    struct IntervalStartCmp {
+        bool operator()(const interval& a, const interval& b) {
+            return a.start < b.start;
+        }
+    };
+
+    FlatIntervalTree()
+        : max_level(-1)
+    {}
+
+    ~FlatIntervalTree() = default;
+
+    FlatIntervalTree(const FlatIntervalTree&) = default;
+    FlatIntervalTree& operator=(const FlatIntervalTree&) = default;
+    FlatIntervalTree(FlatIntervalTree&&) = default;
+    FlatIntervalTree& operator=(FlatIntervalTree&&) = default;
+
+    explicit FlatIntervalTree(interval_vector&& ivals)
+        : intervals(std::move(ivals))
+        , max_level(-1)
+    {
+        std::stable_sort(intervals.begin(), intervals.end(), IntervalStartCmp());
+        index();
+    }
+
+    // Call f on all intervals crossing pos
+    template <class UnaryFunction>
+    void visit_overlapping(const Scalar& pos, UnaryFunction f) const {
+        visit_overlapping(pos, pos, f);
+    }
+
+    // Call f on all intervals overlapping [start, stop]
+    template <class UnaryFunction>
+    void visit_overlapping(const Scalar& start, const Scalar& stop, UnaryFunction f) const {
+        const std::size_t n = intervals.size();
+        if (n == 0) {
+            return;
+        }
+        StackEntry stack[64];
+        int t = 0;
+        stack[t++] = StackEntry{max_level, (std::size_t(1) << max_level) - 1, false};
+        while (t) {
+            const StackEntry z = stack[--t];
+            if (z.level <= leaf_scan_level) {
+                // Small subtree: a linear scan in array order is cheaper than walking the remaining levels
+                std::size_t i = z.node >> z.level << z.level;
+                std::size_t end = i + (std::size_t(1) << (z.level + 1)) - 1;
+                if (end > n) {
+                    end = n;
+                }
+                for (; i < end && !(stop < intervals[i].start); ++i) {
+                    if (!(intervals[i].stop < start)) {
+                        f(intervals[i]);
+                    }
+                }
+            } else if (!z.left_done) {
+                // Revisit this node after its left child; the left child may lie past the end of the array
+                const std::size_t y = z.node - (std::size_t(1) << (z.level - 1));
+                stack[t++] = StackEntry{z.level, z.node, true};
+                if (y >= n || !(max_stop[y] < start)) {
+                    stack[t++] = StackEntry{z.level - 1, y, false};
+                }
+            } else if (z.node < n && !(stop < intervals[z.node].start)) {
+                if (!(intervals[z.node].stop < start)) {
+                    f(intervals[z.node]);
+                }
+                stack[t++] = StackEntry{z.level - 1, z.node + (std::size_t(1) << (z.level - 1)), false};
+            }
+        }
+    }
+
+    // Call f on all intervals contained within [start, stop]
+    template <class UnaryFunction>
+    void visit_contained(const Scalar& start, const Scalar& stop, UnaryFunction f) const {
+        auto filterF = [&](const interval& interval) {
+            if (start <= interval.start && interval.stop <= stop) {
+                f(interval);
+            }
+        };
+        visit_overlapping(start, stop, filterF);
+    }
+
+    // Call f(query_index, interval) for every interval overlapping each query.  Queries must be sorted by start;
+    // the batch is answered with a single forward sweep over the sorted intervals, keeping only the intervals
+    // that can still reach the current query start.
+    template <class BinaryFunction>
+    void visit_overlapping_sorted(const std::vector<query>& queries, BinaryFunction f) const {
+        assert(std::is_sorted(queries.begin(), queries.end(),
+                              [](const query& a, const query& b) { return a.first < b.first; }));
+        std::vector<std::size_t> active;
+        std::size_t next = 0;
+        for (std::size_t q = 0; q < queries.size(); ++q) {
+            const Scalar& start = queries[q].first;
+            const Scalar& stop = queries[q].second;
+            std::size_t kept = 0;
+            for (std::size_t a = 0; a < active.size(); ++a) {
+                if (!(intervals[active[a]].stop < start)) {
+                    active[kept++] = active[a];
+                }
+            }
+            active.resize(kept);
+            for (; next < intervals.size() && !(stop < intervals[next].start); ++next) {
+                if (!(intervals[next].stop < start)) {
+                    active.push_back(next);
+                }
+            }
+            for (std::size_t a = 0; a < active.size(); ++a) {
+                if (!(stop < intervals[active[a]].start)) {
+                    f(q, intervals[active[a]]);
+                }
+            }
+        }
+    }
+
+    interval_vector findOverlapping(const Scalar& start, const Scalar& stop) const {
+        interval_vector result;
+        visit_overlapping(start, stop,
+                          [&](const interval& interval) {
+                            result.emplace_back(interval);
+                          });
+        return result;
+    }
+
+    interval_vector findContained(const Scalar& start, const Scalar& stop) const {
+        interval_vector result;
+        visit_contained(start, stop,
+                        [&](const interval& interval) {
+                          result.push_back(interval);
+                        });
+        return result;
+    }
+
+    std::vector<interval_vector> findOverlappingSorted(const std::vector<query>& queries) const {
+        std::vector<interval_vector> result(queries.size());
+        visit_overlapping_sorted(queries,
+                                 [&](std::size_t q, const interval& interval) {
+                                   result[q].push_back(interval);
+                                 });
+        return result;
+    }
+
+    bool empty() const {
+        return intervals.empty();
+    }
+
+    std::size_t size() const {
+        return intervals.size();
+    }
+
+    template <class UnaryFunction>
+    void visit_all(UnaryFunction f) const {
+        std::for_each(intervals.begin(), intervals.end(), f);
+    }
+
+private:
+    // Subtrees at or below this level (up to 2^(level+1) - 1 intervals) are scanned linearly
+    static const int leaf_scan_level = 6;
+
+    struct StackEntry {
+        int level;
+        std::size_t node;
+        bool left_done;
+    };
+
+    // Fill max_stop bottom-up.  Nodes whose right subtree runs past the end of the array take the max stop of the
+    // last complete subtree on that level ("last" below), following the cgranges construction.
+    void index() {
+        const std::size_t n = intervals.size();
+        max_stop.assign(n, Scalar());
+        if (n == 0) {
+            max_level = -1;
+            return;
+        }
+        std::size_t last_i = 0;
+        Scalar last = intervals[0].stop;
+        for (std::size_t i = 0; i < n; i += 2) {
+            last_i = i;
+            last = max_stop[i] = intervals[i].stop;
+        }
+        int k = 1;
+        for (; (std::size_t(1) << k) <= n; ++k) {
+            const std::size_t x = std::size_t(1) << (k - 1);
+            const std::size_t i0 = (x << 1) - 1;
+            const std::size_t step = x << 2;
+            for (std::size_t i = i0; i < n; i += step) {
+                Scalar e = intervals[i].stop;
+                e = std::max(e, max_stop[i - x]);
+                e = std::max(e, (i + x < n) ? max_stop[i + x] : last);
+                max_stop[i] = e;
+            }
+            last_i = ((last_i >> k) & 1) ? last_i - x : last_i + x;
+            if (last_i < n && last < max_stop[last_i]) {
+                last = max_stop[last_i];
+            }
+        }
+        max_level = k - 1;
+    }
+
+    interval_vector intervals;
+    std::vector<Scalar> max_stop;
+    int max_level;
+};
+#ifdef USE_INTERVAL_TREE_NAMESPACE
+}
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+#include "alloc_stats.h"
+#include <cstdlib>
+#include <new>
+
+
+#ifdef SIMPLE_SNP_ALLOC_STATS
+
+// Constant-initialized, so it is usable from operator new before and after any other thread_local
+static thread_local long thread_allocations = 0;
+
+
+void* operator new(std::size_t size)
+{
+    thread_allocations++;
+    void* ptr = std::malloc((size > 0) ? size : 1);
+    if(ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    thread_allocations++;
+    return std::malloc((size > 0) ? size : 1);
+}
+
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+
+bool allocStatsEnabled()
+{
+    return true;
+}
+
+
+long threadAllocations()
+{
+    return thread_allocations;
+}
+
+#else
+
+bool allocStatsEnabled()
+{
+    return false;
+}
+
+
+long threadAllocations()
+{
+    return 0;
+}
+
+#endif
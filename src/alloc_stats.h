@@ -0,0 +1,14 @@
+#ifndef SIMPLE_SNP_ALLOC_STATS_H
+#define SIMPLE_SNP_ALLOC_STATS_H
+
+
+// Heap allocation counting, to check that hot loops reach a steady state that allocates nothing.  Only built with
+// -DSIMPLE_SNP_ALLOC_STATS (make ALLOC_STATS=1), which replaces the global operator new with one that counts the
+// calling thread's allocations; otherwise the count is always zero and allocStatsEnabled() is false.
+bool allocStatsEnabled();
+
+// Allocations made by the calling thread so far
+long threadAllocations();
+
+
+#endif //SIMPLE_SNP_ALLOC_STATS_H
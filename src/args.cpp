@@ -16,7 +16,10 @@ Args::Args(int argc, const char *argv[])
     }
 
     // User-specified required values
-    sam_file_dir = _findFullDirPath(arg_list[1]);
+    sam_file_dir = arg_list[1];
+    if(sam_file_dir != "-") {
+        sam_file_dir = _findFullDirPath(sam_file_dir);
+    }
     output_dir = arg_list[2];
     reference_path = _findFullDirPath(arg_list[3]);
 
@@ -51,6 +54,41 @@ Args::Args(int argc, const char *argv[])
             large_indel_border_ratio = std::stod(arg_list[++i].c_str());
         else if(arg_list[i] == "-t")
             threads = std::stoi(arg_list[++i].c_str());
+        else if(arg_list[i] == "-m")
+            max_depth = std::stoi(arg_list[++i].c_str());
+        else if(arg_list[i] == "-q")
+            min_mapq = std::stoi(arg_list[++i].c_str());
+        else if(arg_list[i] == "-Q")
+            min_base_qual = std::stoi(arg_list[++i].c_str());
+        else if(arg_list[i] == "-c") {
+            pileup_cache_dir = arg_list[++i];
+            if(!std::filesystem::is_directory(pileup_cache_dir)) {
+                std::filesystem::create_directories(pileup_cache_dir);
+            }
+            pileup_cache_dir = _findFullDirPath(pileup_cache_dir);
+        }
+        else if(arg_list[i] == "-s") {
+            cohort_store_dir = arg_list[++i];
+            if(!std::filesystem::is_directory(cohort_store_dir)) {
+                std::filesystem::create_directories(cohort_store_dir);
+            }
+            cohort_store_dir = _findFullDirPath(cohort_store_dir);
+        }
+        else if(arg_list[i] == "-o") {
+            spill_dir = arg_list[++i];
+            if(!std::filesystem::is_directory(spill_dir)) {
+                std::filesystem::create_directories(spill_dir);
+            }
+            spill_dir = _findFullDirPath(spill_dir);
+        }
+        else if(arg_list[i] == "-b")
+            spill_block_size = std::stol(arg_list[++i].c_str());
+        else if(arg_list[i] == "-r")
+            read_ahead_blocks = std::stoi(arg_list[++i].c_str());
+        else if(arg_list[i] == "-u")
+            prefetch_input = true;
+        else if(arg_list[i] == "-T")
+            trace_path = arg_list[++i];
         else if(arg_list[i] == "-n") {
             std::size_t start_pos = reference_path.find_last_of(".");
             std::string ref_prefix = reference_path;
@@ -62,6 +100,7 @@ Args::Args(int argc, const char *argv[])
                 std::cerr << std::endl;
                 std::exit(EXIT_FAILURE);
             }
+            db_index_file = ref_prefix + ".dbidx";
             db_names_file = ref_prefix + ".names";
             if(!std::filesystem::exists(db_names_file)) {
                 db_names_file = "";
@@ -76,6 +115,21 @@ Args::Args(int argc, const char *argv[])
         }
     }
 
+    // The cohort store doubles as the pileup cache so newly parsed samples land in it
+    if(!cohort_store_dir.empty()) {
+        pileup_cache_dir = cohort_store_dir;
+    }
+
+    if(spill_block_size < 1) {
+        std::cerr << "ERROR: Out-of-core block size must be at least 1, provided: " << spill_block_size << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if(read_ahead_blocks < 1) {
+        std::cerr << "ERROR: Read-ahead must be at least 1 block, provided: " << read_ahead_blocks << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
     if(threads < 3) {
         std::cerr << "ERROR: Threads must be at least 3, provided: " << threads << std::endl;
         std::exit(EXIT_FAILURE);
@@ -103,6 +157,8 @@ void Args::_usage()
 {
     std::cout << std::endl << "Usage:" << std::endl;
     std::cout << "\tsimple_snp sam_file_dir/ output_dir/ reference.fasta [options]" << std::endl << std::endl;
+    std::cout << "\tsam_file_dir/ holds .sam and .sam.gz files; it may instead be a single SAM file, a named pipe, or";
+    std::cout << " - to read one SAM stream from stdin" << std::endl << std::endl;
     std::cout << "SNP-Calling Options:" << std::endl;
     std::cout << "\t-a\tWithin-sample minimum alternate allele count to call a variant [3]" << std::endl;
     std::cout << "\t-A\tBetween-sample minimum alternate allele count to call a variant [7]" << std::endl;
@@ -120,10 +176,35 @@ void Args::_usage()
     std::cout << "\t-Lr\tLarge indel borders must rise/fall this frequency of coverage to be considered sharp [0.2]" << std::endl;
     std::cout << std::endl;
 
+    std::cout << "Read Filtering Options:" << std::endl;
+    std::cout << "\t-m\tMaximum depth at read starts: a read starting where coverage already reached this depth is";
+    std::cout << " skipped before its CIGAR is walked.  Reads are kept in input order (the first reads in the file win,";
+    std::cout << " no sampling), and coverage past a start can exceed it [0 = off]" << std::endl;
+    std::cout << "\t-q\tMinimum read mapping quality (MAPQ) to pile up a read [0]" << std::endl;
+    std::cout << "\t-Q\tMinimum base quality (Phred) to count a base [0]" << std::endl;
+    std::cout << std::endl;
+
     std::cout << "General Options:" << std::endl;
+    std::cout << "\t-c\tDirectory for cached per-sample pileups, reused while the SAM file is unchanged [off]";
+    std::cout << std::endl;
+    std::cout << "\t-s\tCohort store directory for incremental runs: only SAM files not yet in the store are parsed,";
+    std::cout << " and calling covers every stored sample (implies -c <dir>) [off]" << std::endl;
+    std::cout << "\t-o\tOut-of-core mode: spill each sample's pileup to this directory and call all samples by streaming";
+    std::cout << " them in position blocks, so memory scales with block size instead of genome size [off]" << std::endl;
+    std::cout << "\t\tCoordinate-sorted SAM files (@HD SO:coordinate) are then piled up through a sliding window";
+    std::cout << " instead of whole-reference arrays" << std::endl;
+    std::cout << "\t-b\tPositions per block streamed from each sample in out-of-core mode (-o) [16384]" << std::endl;
+    std::cout << "\t-r\tInput blocks (1 MiB) read and decompressed ahead of the parser for each SAM file [4]";
+    std::cout << std::endl;
+    std::cout << "\t-u\tFlag for cohorts of many small SAM files: read whole files (up to 16 MiB) ahead of the parsers in";
+    std::cout << " batched io_uring submissions, or with pread where io_uring is unavailable.  Meant for storage where";
+    std::cout << " opening and reading a file is slow; on a warm page cache parsers reading their own files are faster";
+    std::cout << std::endl;
     std::cout << "\t-n\tFlag indicating that a <reference>.ann file is present (use parent-child relations)";
     std::cout << std::endl;
     std::cout << "\t-t\tThreads to use, minimum 3 [3]" << std::endl;
+    std::cout << "\t-T\tWrite a timeline of thread pool tasks and their stages to this file, in Chrome Trace Event";
+    std::cout << " JSON for a trace viewer (e.g. Perfetto) [off]" << std::endl;
     std::cout << std::endl << std::endl;
     std::exit(EXIT_FAILURE);
 }
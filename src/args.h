@@ -8,6 +8,7 @@
 #include <vector>
 #include <limits.h>
 #include <unordered_map>
+#include "database_index.h"
 
 
 class Args {
@@ -19,6 +20,10 @@ public:
     std::string reference_path;
     std::string db_ann_file = "";
     std::string db_names_file = "";
+    std::string db_index_file = "";
+    std::string pileup_cache_dir = "";
+    std::string cohort_store_dir = "";
+    std::string spill_dir = "";
     int min_intra_sample_alt = 3;
     int min_inter_sample_alt = 7;
     int min_intra_sample_depth = 5;
@@ -31,21 +36,16 @@ public:
     double min_major_freq = 0.7;
     double min_minor_freq = 0.4;
     int threads = 3;
-
-    // { acc: < < start, stop, strand, gene, product > > }
-    std::unordered_map< std::string, std::vector< std::vector< std::string > > > db_ann_map;
-
-    // { acc_parent: < acc_child1, acc_child2, ... > }
-    std::unordered_map< std::string, std::vector< std::string > > db_parent_map;
-
-    // { acc_child: acc_parent }
-    std::unordered_map< std::string, std::string > rev_db_parent_map;
-
-    // { acc_parent: name }
-    std::unordered_map< std::string, std::string > db_parent_name_map;
-
-    // { acc_child: name }
-    std::unordered_map< std::string, std::string > db_child_name_map;
+    int max_depth = 0;
+    int min_mapq = 0;
+    int min_base_qual = 0;
+    long spill_block_size = 16384;
+    int read_ahead_blocks = 4;
+    bool prefetch_input = false;
+    std::string trace_path = "";
+
+    // Compiled <reference_db>.ann/.names (parent/child relations, names and annotations), see database_index.h
+    DatabaseIndex db_index;
 
 private:
     std::string _findFullDirPath(std::string path);
@@ -0,0 +1,118 @@
+#include "cohort_store.h"
+#include "pileup_cache.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <unistd.h>
+
+
+CohortStore::CohortStore(const std::string &store_dir)
+        : _store_dir(store_dir), _manifest_path(store_dir + "/cohort_manifest.tsv")
+{
+
+}
+
+
+void CohortStore::loadManifest()
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    std::ifstream ifs(_manifest_path, std::ios::in);
+    if(!ifs.is_open()) {
+        return;
+    }
+
+    // pileup_file_name \t sam_cache_key
+    std::string line;
+    while(std::getline(ifs, line)) {
+        std::size_t tab_pos = line.find('\t');
+        if(line.empty() || (tab_pos == std::string::npos)) {
+            continue;
+        }
+        entries[_store_dir + "/" + line.substr(0, tab_pos)] = line.substr(tab_pos + 1);
+    }
+    ifs.close();
+}
+
+
+void CohortStore::writeManifest()
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    std::string tmp_path = _manifest_path + ".tmp." + std::to_string(getpid());
+    std::ofstream ofs(tmp_path);
+    if(!ofs.is_open()) {
+        std::cerr << "ERROR: Could not write cohort store manifest: " << _manifest_path << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    for(auto &[pileup_path, key] : entries) {
+        ofs << pileup_path.substr(pileup_path.find_last_of('/') + 1) << '\t' << key << std::endl;
+    }
+    ofs.close();
+    if(ofs.fail() || (std::rename(tmp_path.c_str(), _manifest_path.c_str()) != 0)) {
+        std::remove(tmp_path.c_str());
+        std::cerr << "ERROR: Could not write cohort store manifest: " << _manifest_path << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+
+bool CohortStore::contains(const std::string &pileup_path, const std::string &key)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    auto found = entries.find(pileup_path);
+    return (found != entries.end()) && (found->second == key);
+}
+
+
+bool CohortStore::builtWith(const std::string &pileup_path, const std::string &options_key)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    auto found = entries.find(pileup_path);
+    if(found == entries.end()) {
+        return false;
+    }
+    // Keys are <SAM path>|<size>|<mtime>|<options key>
+    const std::string &key = found->second;
+    std::string suffix = '|' + options_key;
+    return (key.size() > suffix.size()) && (key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+
+void CohortStore::add(const std::string &pileup_path, const std::string &key)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    entries[pileup_path] = key;
+}
+
+
+void CohortStore::remove(const std::string &pileup_path)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    entries.erase(pileup_path);
+    std::remove(pileup_path.c_str());
+}
+
+
+void CohortStore::loadSample(const std::string &pileup_path, ConcurrentBufferQueue* buffer_q)
+{
+    std::string key;
+    {
+        std::unique_lock< std::mutex > lock(_mtx);
+        key = entries.at(pileup_path);
+    }
+
+    std::vector< std::string > refs;
+    std::vector< long > ref_lens;
+    std::vector< SamplePileup > pileups;
+
+    PileupCache cache(pileup_path, key);
+    if(!cache.load(refs, ref_lens, pileups)) {
+        std::cerr << "ERROR: Cohort store pileup is missing or does not match its manifest entry: " << pileup_path;
+        std::cerr << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::string pileup_filename = pileup_path.substr(pileup_path.find_last_of('/') + 1);
+    buffer_q->pushPileups(pileup_filename.substr(0, pileup_filename.find_last_of('.')), refs, ref_lens, std::move(pileups));
+}
@@ -0,0 +1,42 @@
+#ifndef SIMPLE_SNP_COHORT_STORE_H
+#define SIMPLE_SNP_COHORT_STORE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include "concurrent_buffer_queue.h"
+
+
+// On-disk cohort of per-sample pileups for incremental runs.  The store directory holds one PileupCache file per
+// ingested sample, named after the sample (ParserJob writes them there), and a manifest mapping each pileup file to
+// the cache key of the SAM it came from.  A run parses only SAM files whose key is not in the manifest, replacing
+// their samples' entries, and loads every other stored sample straight from its pileup file, so historical SAM
+// files do not need to be present.  Loaded samples are merged as they are, so their keys must carry this run's
+// reference and parse options.
+class CohortStore {
+public:
+    CohortStore(const std::string &store_dir);
+
+    void loadManifest();
+    void writeManifest();
+    bool contains(const std::string &pileup_path, const std::string &key);
+
+    // Whether the entry was parsed with the reference and parse options of options_key (ParserJob::pileupOptionsKey)
+    bool builtWith(const std::string &pileup_path, const std::string &options_key);
+    void add(const std::string &pileup_path, const std::string &key);
+
+    // Drop the entry and delete its pileup file
+    void remove(const std::string &pileup_path);
+    void loadSample(const std::string &pileup_path, ConcurrentBufferQueue* buffer_q);
+
+    // { pileup file path : SAM cache key }
+    std::map< std::string, std::string > entries;
+
+private:
+    std::string _store_dir;
+    std::string _manifest_path;
+    std::mutex _mtx;
+};
+
+
+#endif //SIMPLE_SNP_COHORT_STORE_H
@@ -1,7 +1,10 @@
 #include "concurrent_buffer_queue.h"
+#include "pileup_spill.h"
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <thread>
+#include <chrono>
 
 
 ConcurrentBufferQueue::ConcurrentBufferQueue()
@@ -18,41 +21,219 @@ ConcurrentBufferQueue::~ConcurrentBufferQueue()
 
 void ConcurrentBufferQueue::run()
 {
-    std::string output_line, data_line, barcode;
-    std::stringstream ss;
-    while((!all_jobs_enqueued) || (!all_jobs_consumed)) {}
+    PushedResult result;
+    int spins = 0;
+    while(true) {
+        // Every result of a consumed job was pushed before the flags were set, so one more drain after seeing them
+        // empties the queue for good
+        bool finished = all_jobs_enqueued && all_jobs_consumed;
+        while(_results.pop(result)) {
+            _ingest(result);
+            spins = 0;
+        }
+        if(finished) {
+            break;
+        }
+        // Idle while the parsers work: yield for a short while, then sleep so the consumer does not hold a core
+        if(spins < 64) {
+            spins++;
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
 
     work_completed = true;
 }
 
 
-bool ConcurrentBufferQueue::tryPush(const std::string &sample_name,
-                                    const std::string &ref_name,
-                                    const std::vector< std::vector< int > > &nucleotide_counts,
-                                    const std::vector< std::vector< long > > &qual_sums,
-                                    const std::vector< std::vector < long > > &mapq_sums,
-                                    const std::unordered_map< long, std::unordered_map< int, std::vector< long > > > &insertions,
-                                    const std::unordered_map< long, std::unordered_map< int, std::vector< long > > > &deletions)
+void ConcurrentBufferQueue::push(const std::string &sample_name, const std::string &ref_name, RefPileup &&ref_pileup)
+{
+    PushedResult result;
+    result.kind = PushedResult::Kind::pileup;
+    result.sample_name = sample_name;
+    result.ref_name = ref_name;
+    result.pileup = std::make_unique< RefPileup >(std::move(ref_pileup));
+    _results.push(std::move(result));
+}
+
+
+void ConcurrentBufferQueue::pushSpill(const std::string &sample_name,
+                                      const std::string &ref_name,
+                                      const std::string &spill_path)
+{
+    PushedResult result;
+    result.kind = PushedResult::Kind::spill;
+    result.sample_name = sample_name;
+    result.ref_name = ref_name;
+    result.path = spill_path;
+    _results.push(std::move(result));
+}
+
+
+void ConcurrentBufferQueue::expectParse(const std::string &sam_filepath,
+                                        const std::string &parent_ref,
+                                        const std::vector< std::string > &refs,
+                                        const std::vector< std::string > &samples)
+{
+    ExpectedParse expected;
+    expected.parent_ref = ref_names.intern(parent_ref);
+    for(const std::string &ref : refs) {
+        expected.refs.push_back(ref_names.intern(ref));
+    }
+    for(const std::string &sample : samples) {
+        expected.samples.push_back(sample_names.intern(sample));
+    }
+
+    std::unique_lock< std::mutex > lock(_mtx);
+    _pending_ref_parses.resize(ref_names.size(), 0);
+    _unseen_samples.resize(ref_names.size());
+    for(const int &ref : expected.refs) {
+        _pending_ref_parses[ref]++;
+    }
+    _unseen_samples[expected.parent_ref].insert(expected.samples.begin(), expected.samples.end());
+    _expected_parses[sam_filepath] = std::move(expected);
+}
+
+
+void ConcurrentBufferQueue::completeParse(const std::string &sam_filepath)
+{
+    PushedResult result;
+    result.kind = PushedResult::Kind::parse_completed;
+    result.path = sam_filepath;
+    _results.push(std::move(result));
+}
+
+
+void ConcurrentBufferQueue::_ingest(PushedResult &result)
 {
+    if(result.kind == PushedResult::Kind::parse_completed) {
+        _ingestCompletedParse(result.path);
+        num_ingested_parses += 1;
+        return;
+    }
+
+    StageTimer timer(metrics, RunMetrics::pileup_ingest);
+    // Interned here rather than by the producers, so only this thread takes the name tables' locks on the push path
+    int sample = sample_names.intern(result.sample_name);
+    int ref = ref_names.intern(result.ref_name);
     std::unique_lock< std::mutex > lock(_mtx);
-    if(!all_nucleotide_counts.count(sample_name)) {
-        all_nucleotide_counts[sample_name];
-        all_qual_sums[sample_name];
-        all_mapq_sums[sample_name];
-        all_insertions[sample_name];
-        all_deletions[sample_name];
-    }
-    if(all_nucleotide_counts.at(sample_name).count(ref_name)) {
-        std::cerr << "ERROR: Duplicate sample + reference combination detected: " << sample_name;
-        std::cerr << ", " << ref_name << std::endl;
+    bool duplicate;
+    if(result.kind == PushedResult::Kind::spill) {
+        if(all_spills.size() <= sample) {
+            all_spills.resize(sample + 1);
+        }
+        std::vector< std::string > &sample_spills = all_spills[sample];
+        if(sample_spills.size() <= ref) {
+            sample_spills.resize(ref + 1);
+        }
+        duplicate = !sample_spills[ref].empty();
+        if(!duplicate) {
+            sample_spills[ref] = result.path;
+        }
+    }
+    else {
+        if(all_pileups.size() <= sample) {
+            all_pileups.resize(sample + 1);
+        }
+        std::vector< std::unique_ptr< RefPileup > > &sample_pileups = all_pileups[sample];
+        if(sample_pileups.size() <= ref) {
+            sample_pileups.resize(ref + 1);
+        }
+        duplicate = (sample_pileups[ref] != nullptr);
+        if(!duplicate) {
+            sample_pileups[ref] = std::move(result.pileup);
+        }
+    }
+    if(duplicate) {
+        std::cerr << "ERROR: Duplicate sample + reference combination detected: ";
+        std::cerr << sample_names.name(sample) << ", " << ref_names.name(ref) << std::endl;
         std::exit(EXIT_FAILURE);
     }
+}
+
+
+void ConcurrentBufferQueue::_ingestCompletedParse(const std::string &sam_filepath)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    auto found = _expected_parses.find(sam_filepath);
+    if(found == _expected_parses.end()) {
+        return;
+    }
+    for(const int &ref : found->second.refs) {
+        _pending_ref_parses[ref]--;
+    }
+    for(const int &sample : found->second.samples) {
+        _unseen_samples[found->second.parent_ref].erase(sample);
+    }
+    _expected_parses.erase(found);
+    lock.unlock();
+    _ready_cv.notify_all();
+}
+
+
+bool ConcurrentBufferQueue::refReady(const int &parent_ref, const int &ref)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    return _refReady(parent_ref, ref);
+}
+
+
+void ConcurrentBufferQueue::waitRefReady(const int &parent_ref, const int &ref)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    _ready_cv.wait(lock, [this, &parent_ref, &ref] () {return _refReady(parent_ref, ref);});
+}
 
-    all_nucleotide_counts.at(sample_name)[ref_name] = nucleotide_counts;
-    all_qual_sums.at(sample_name)[ref_name] = qual_sums;
-    all_mapq_sums.at(sample_name)[ref_name] = mapq_sums;
-    all_insertions.at(sample_name)[ref_name] = insertions;
-    all_deletions.at(sample_name)[ref_name] = deletions;
 
-    return true;
+bool ConcurrentBufferQueue::_refReady(const int &parent_ref, const int &ref) const
+{
+    return ((ref >= _pending_ref_parses.size()) || (_pending_ref_parses[ref] == 0))
+            && ((parent_ref >= _unseen_samples.size()) || _unseen_samples[parent_ref].empty());
+}
+
+
+std::unique_lock< std::mutex > ConcurrentBufferQueue::lockPileups()
+{
+    return std::unique_lock< std::mutex >(_mtx);
+}
+
+
+std::string ConcurrentBufferQueue::spillPath(const std::string &spill_name) const
+{
+    return spill_dir + "/" + spill_name + ".spill";
+}
+
+
+void ConcurrentBufferQueue::pushPileups(const std::string &spill_name,
+                                        const std::vector< std::string > &refs,
+                                        const std::vector< long > &ref_lens,
+                                        std::vector< SamplePileup > &&pileups)
+{
+    for(int p = 0; p < pileups.size(); ++p) {
+        SamplePileup &pileup = pileups[p];
+        if(spill_dir.empty()) {
+            for(int r = 0; r < refs.size(); ++r) {
+                push(pileup.sample_id, refs[r], std::move(pileup.refs[r]));
+            }
+            continue;
+        }
+
+        std::string spill_path = spillPath(spill_name);
+        if(pileups.size() > 1) {
+            spill_path = spillPath(spill_name + '.' + std::to_string(p));
+        }
+        if(!PileupSpill::write(spill_path,
+                               pileup.sample_id,
+                               refs,
+                               ref_lens,
+                               pileup.refs)) {
+            std::cerr << "ERROR: Could not write pileup spill file: " << spill_path << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        for(int r = 0; r < refs.size(); ++r) {
+            pushSpill(pileup.sample_id, refs[r], spill_path);
+        }
+    }
 }
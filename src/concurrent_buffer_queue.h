@@ -4,11 +4,20 @@
 #include <cassert>
 #include <iostream>
 #include <mutex>
+#include <condition_variable>
 #include <queue>
 #include <atomic>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include <memory>
+#include "paged_array.h"
+#include "sample_pileup.h"
+#include "input_prefetcher.h"
+#include "mpsc_queue.h"
+#include "name_table.h"
+#include "run_metrics.h"
 
 
 class ConcurrentBufferQueue {
@@ -16,14 +25,24 @@ public:
     ConcurrentBufferQueue();
     ~ConcurrentBufferQueue();
 
+    // Consumer of published results (runs on its own thread until all jobs are consumed): inserts them into the
+    // tables below, reporting duplicate sample + reference combinations, and applies parse completions
     void run();
-    bool tryPush(const std::string &sample_name,
-                 const std::string &ref_name,
-                 const std::vector< std::vector< int > > &nucleotide_counts,
-                 const std::vector< std::vector< long > > &qual_sums,
-                 const std::vector< std::vector < long > > &mapq_sums,
-                 const std::unordered_map< long, std::unordered_map< int, std::vector< long > > > &insertions,
-                 const std::unordered_map< long, std::unordered_map< int, std::vector< long > > > &deletions);
+
+    // Publish one sample's pileup of one reference, moved into the ingestion queue.  The names travel with it and
+    // are interned by run(), so producers never take a lock: they only contend on one atomic exchange, and the
+    // tables below and the name ids are written by run() alone.
+    void push(const std::string &sample_name, const std::string &ref_name, RefPileup &&ref_pileup);
+    void pushSpill(const std::string &sample_name, const std::string &ref_name, const std::string &spill_path);
+    std::string spillPath(const std::string &spill_name) const;
+
+    // Publish every reference of each sample of one pileup.  In out-of-core mode (spill_dir set) each sample is
+    // written to <spill_dir>/<spill_name>.spill (<spill_name>.<sample index>.spill when there are several) and
+    // only the spill path is kept; otherwise each reference is moved out of pileups into push.
+    void pushPileups(const std::string &spill_name,
+                     const std::vector< std::string > &refs,
+                     const std::vector< long > &ref_lens,
+                     std::vector< SamplePileup > &&pileups);
 
     std::atomic< bool > all_jobs_enqueued = ATOMIC_VAR_INIT(false);
     std::atomic< bool > all_jobs_consumed = ATOMIC_VAR_INIT(false);
@@ -31,14 +50,79 @@ public:
     std::atomic< int > num_active_jobs = ATOMIC_VAR_INIT(0);
     std::atomic< int > num_completed_jobs = ATOMIC_VAR_INIT(0);
 
-    std::unordered_map< std::string, std::unordered_map< std::string, std::vector< std::vector< int > > > > all_nucleotide_counts;
-    std::unordered_map< std::string, std::unordered_map< std::string, std::vector< std::vector< long > > > > all_qual_sums;
-    std::unordered_map< std::string, std::unordered_map< std::string, std::vector< std::vector< long > > > > all_mapq_sums;
-    std::unordered_map< std::string, std::unordered_map< std::string, std::unordered_map< long, std::unordered_map< int, std::vector< long > > > > > all_insertions;
-    std::unordered_map< std::string, std::unordered_map< std::string, std::unordered_map< long, std::unordered_map< int, std::vector< long > > > > > all_deletions;
+    // Stage times and counters of the whole run, added to by parse jobs, this queue, callers and main
+    RunMetrics metrics;
+
+    // Calling overlaps parsing (see main): expectParse() registers a SAM file with the parent reference group,
+    // references and samples it will push.  A reference is ready to call once every registered file covering it has
+    // completed and every sample of its group has pushed its first file; unregistered references are always ready.
+    // completeParse() is published behind the file's results, so readiness always follows their insertion.
+    // Readiness is queried by the ref_names ids of the parent reference and the reference.
+    void expectParse(const std::string &sam_filepath,
+                     const std::string &parent_ref,
+                     const std::vector< std::string > &refs,
+                     const std::vector< std::string > &samples);
+    void completeParse(const std::string &sam_filepath);
+    bool refReady(const int &parent_ref, const int &ref);
+    void waitRefReady(const int &parent_ref, const int &ref);
+
+    // Held while looking up the pileup tables below as long as parse jobs may still add samples and references
+    std::unique_lock< std::mutex > lockPileups();
+
+    // Parse completions applied by run(), whether or not the file was registered
+    std::atomic< int > num_ingested_parses = ATOMIC_VAR_INIT(0);
+
+    // Whole-file read-ahead of the SAM files being parsed (-u), owned by main
+    InputPrefetcher* input_prefetcher = nullptr;
+
+    // Ids of the samples and references (parent references included) in order of discovery: pre-flight
+    // registration, then first push
+    NameTable sample_names;
+    NameTable ref_names;
+
+    // [sample id][ref id]: pileup of each sample on each reference it pushed, null where it has none.  The tables
+    // grow as ids are added, but a pileup never moves once inserted.
+    std::vector< std::vector< std::unique_ptr< RefPileup > > > all_pileups;
+
+    // Out-of-core mode: [sample id][ref id] spill path, empty where none, in place of the in-memory pileups above
+    std::string spill_dir = "";
+    std::vector< std::vector< std::string > > all_spills;
 
 private:
+    // Ids of the parent reference, references and samples of one registered SAM file
+    struct ExpectedParse {
+        int parent_ref;
+        std::vector< int > refs;
+        std::vector< int > samples;
+    };
+
+    // One published result: a sample's pileup of one reference, its spill path, or the end of a parse job
+    struct PushedResult {
+        enum class Kind { pileup, spill, parse_completed };
+
+        Kind kind = Kind::pileup;
+        std::string sample_name;
+        std::string ref_name;
+        // Spill path, or SAM path of a completed parse
+        std::string path;
+        // Held by pointer so the queue can move results around without assigning the pileup
+        std::unique_ptr< RefPileup > pileup;
+    };
+
+    void _ingest(PushedResult &result);
+    void _ingestCompletedParse(const std::string &sam_filepath);
+    bool _refReady(const int &parent_ref, const int &ref) const;
+
+    MpscQueue< PushedResult > _results;
+
+    // Guards the pileup tables and readiness state against concurrent lookups; producers never take it
     std::mutex _mtx;
+    std::condition_variable _ready_cv;
+    // { SAM path : what it pushes }, [ref id] registered files not yet completed, and [parent ref id] samples
+    // without a completed file
+    std::unordered_map< std::string, ExpectedParse > _expected_parses;
+    std::vector< int > _pending_ref_parses;
+    std::vector< std::unordered_set< int > > _unseen_samples;
 };
 
 
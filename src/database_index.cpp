@@ -0,0 +1,472 @@
+#include "database_index.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const char DB_INDEX_MAGIC[8] = {'S', 'S', 'N', 'P', 'D', 'B', '0', '1'};
+
+
+struct DatabaseIndex::Header {
+    char magic[8];
+    int64_t source_stamps[4];  // .ann size, .ann mtime (ns), .names size, .names mtime (ns)
+    uint64_t num_strings;
+    uint64_t strings_offset;
+    uint64_t num_accessions;
+    uint64_t accessions_offset;
+    uint64_t num_children;
+    uint64_t children_offset;
+    uint64_t num_annotations;
+    uint64_t annotations_offset;
+    uint64_t pool_offset;
+    uint64_t pool_size;
+};
+
+
+struct DatabaseIndex::StringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+
+static void sourceStamp(const std::string &path, int64_t &size, int64_t &mtime)
+{
+    struct stat sb;
+    if(path.empty() || (stat(path.c_str(), &sb) != 0)) {
+        size = -1;
+        mtime = -1;
+        return;
+    }
+    size = (int64_t)sb.st_size;
+    mtime = ((int64_t)sb.st_mtim.tv_sec * 1000000000) + (int64_t)sb.st_mtim.tv_nsec;
+}
+
+
+// GenBank-style partial markers (<1, >1500) are stripped; anything non-numeric becomes -1
+static int64_t _parseCoordinate(const std::string &field)
+{
+    std::size_t i = 0;
+    while((i < field.length()) && ((field[i] == '<') || (field[i] == '>'))) {
+        i++;
+    }
+    char* end;
+    int64_t value = std::strtoll(field.c_str() + i, &end, 10);
+    if(end == (field.c_str() + i)) {
+        return -1;
+    }
+    return value;
+}
+
+
+static std::size_t alignTo8(const std::size_t &offset)
+{
+    return (offset + 7) & ~((std::size_t)7);
+}
+
+
+DatabaseIndex::DatabaseIndex()
+{
+
+}
+
+
+DatabaseIndex::~DatabaseIndex()
+{
+    if(_mapped) {
+        munmap((void*)_data, _data_len);
+    }
+}
+
+
+void DatabaseIndex::load(const std::string &ann_path, const std::string &names_path, const std::string &index_path)
+{
+    std::vector< int64_t > source_stamps(4, -1);
+    sourceStamp(ann_path, source_stamps[0], source_stamps[1]);
+    sourceStamp(names_path, source_stamps[2], source_stamps[3]);
+
+    if(_mapIndex(index_path, source_stamps)) {
+        return;
+    }
+
+    _buildIndex(ann_path, names_path, source_stamps, _owned);
+
+    // Write to a temporary file and rename so concurrent runs never see a partial index.  If the database directory
+    // is read-only the in-memory copy is used for this run only.
+    std::string tmp_path = index_path + ".tmp." + std::to_string(getpid());
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    if(ofs.is_open()) {
+        ofs.write(_owned.data(), _owned.size());
+        ofs.close();
+        if(!ofs.fail() && (std::rename(tmp_path.c_str(), index_path.c_str()) == 0)) {
+            if(_mapIndex(index_path, source_stamps)) {
+                std::vector< char >().swap(_owned);
+                return;
+            }
+        }
+        std::remove(tmp_path.c_str());
+    }
+    _attach(_owned.data());
+}
+
+
+int DatabaseIndex::findAccession(const std::string &acc) const
+{
+    if(_header == nullptr) {
+        return -1;
+    }
+    long lo = 0;
+    long hi = (long)_header->num_accessions - 1;
+    while(lo <= hi) {
+        long mid = lo + ((hi - lo) / 2);
+        int cmp = _compareName(_accessions[mid].name, acc);
+        if(cmp == 0) {
+            return (int)mid;
+        }
+        if(cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+
+bool DatabaseIndex::hasParent(const std::string &acc) const
+{
+    int acc_id = findAccession(acc);
+    return (acc_id >= 0) && (_accessions[acc_id].parent >= 0);
+}
+
+
+std::string DatabaseIndex::parentOf(const std::string &acc) const
+{
+    int acc_id = findAccession(acc);
+    if((acc_id < 0) || (_accessions[acc_id].parent < 0)) {
+        std::cerr << "ERROR: Reference not present in <reference_db>.names, provided: " << acc << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    return accessionName(_accessions[acc_id].parent);
+}
+
+
+std::vector< std::string > DatabaseIndex::childrenOf(const std::string &parent) const
+{
+    std::vector< std::string > ret;
+    int acc_id = findAccession(parent);
+    if(acc_id < 0) {
+        return ret;
+    }
+    const DbAccession &entry = _accessions[acc_id];
+    for(uint32_t i = 0; i < entry.num_children; ++i) {
+        ret.push_back(accessionName(_children[entry.first_child + i]));
+    }
+    return ret;
+}
+
+
+std::string DatabaseIndex::accessionName(const int &acc_id) const
+{
+    return stringAt(_accessions[acc_id].name);
+}
+
+
+std::string DatabaseIndex::stringAt(const uint32_t &string_id) const
+{
+    return std::string(_pool + _strings[string_id].offset, _strings[string_id].length);
+}
+
+
+std::size_t DatabaseIndex::numAccessions() const
+{
+    return (_header == nullptr) ? 0 : _header->num_accessions;
+}
+
+
+const DbAccession& DatabaseIndex::accession(const int &acc_id) const
+{
+    return _accessions[acc_id];
+}
+
+
+const DbAnnotation* DatabaseIndex::annotations(const int &acc_id) const
+{
+    return _annotations + _accessions[acc_id].first_ann;
+}
+
+
+// Private member functions
+bool DatabaseIndex::_mapIndex(const std::string &index_path, const std::vector< int64_t > &source_stamps)
+{
+    int fd = open(index_path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat sb;
+    if((fstat(fd, &sb) != 0) || (sb.st_size < (off_t)sizeof(Header))) {
+        close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+
+    const Header* header = (const Header*)addr;
+    bool valid = (std::memcmp(header->magic, DB_INDEX_MAGIC, sizeof(DB_INDEX_MAGIC)) == 0)
+            && ((header->pool_offset + header->pool_size) <= (uint64_t)sb.st_size);
+    for(int i = 0; valid && (i < 4); ++i) {
+        valid = (header->source_stamps[i] == source_stamps[i]);
+    }
+    if(!valid) {
+        munmap(addr, sb.st_size);
+        return false;
+    }
+
+    if(_mapped) {
+        munmap((void*)_data, _data_len);
+    }
+    _data_len = sb.st_size;
+    _mapped = true;
+    _attach((const char*)addr);
+    return true;
+}
+
+
+void DatabaseIndex::_attach(const char* data)
+{
+    _data = data;
+    _header = (const Header*)data;
+    _strings = (const StringRef*)(data + _header->strings_offset);
+    _accessions = (const DbAccession*)(data + _header->accessions_offset);
+    _children = (const uint32_t*)(data + _header->children_offset);
+    _annotations = (const DbAnnotation*)(data + _header->annotations_offset);
+    _pool = data + _header->pool_offset;
+}
+
+
+int DatabaseIndex::_compareName(const uint32_t &string_id, const std::string &name) const
+{
+    const StringRef &ref = _strings[string_id];
+    int cmp = std::memcmp(_pool + ref.offset, name.data(), std::min((std::size_t)ref.length, name.length()));
+    if(cmp != 0) {
+        return cmp;
+    }
+    if(ref.length == name.length()) {
+        return 0;
+    }
+    return (ref.length < name.length()) ? -1 : 1;
+}
+
+
+void DatabaseIndex::_buildIndex(const std::string &ann_path,
+                                const std::string &names_path,
+                                const std::vector< int64_t > &source_stamps,
+                                std::vector< char > &buffer)
+{
+    // { acc: < < start, stop, strand, gene, product > > }
+    std::unordered_map< std::string, std::vector< std::vector< std::string > > > db_ann_map;
+
+    // { acc_parent: < acc_child1, acc_child2, ... > }
+    std::unordered_map< std::string, std::vector< std::string > > db_parent_map;
+
+    // { acc_child: acc_parent }
+    std::unordered_map< std::string, std::string > rev_db_parent_map;
+
+    // { acc_parent: name }
+    std::unordered_map< std::string, std::string > db_parent_name_map;
+
+    // { acc_child: name }
+    std::unordered_map< std::string, std::string > db_child_name_map;
+
+    if(!ann_path.empty()) {
+        std::ifstream ifs6(ann_path, std::ios::in);
+        std::string ann_line, ann_acc, ann_entry;
+        std::stringstream ann_ss;
+        std::getline(ifs6, ann_line);  // Skip header
+        while(std::getline(ifs6, ann_line)) {
+            if(ann_line.empty()) {
+                continue;
+            }
+            ann_ss.clear();
+            ann_ss.str(ann_line);
+            std::getline(ann_ss, ann_acc, ',');
+            db_ann_map[ann_acc].push_back(std::vector< std::string >());
+            for(int i = 0; i < 5; ++i) {
+                ann_entry = "";
+                std::getline(ann_ss, ann_entry, ',');
+                db_ann_map.at(ann_acc).back().push_back(ann_entry);
+            }
+        }
+        ifs6.close();
+    }
+
+    if(!names_path.empty()) {
+        std::ifstream ifs7(names_path, std::ios::in);
+        std::string names_line, names_parent, names_child, names_alias;
+        std::stringstream names_ss;
+        while(std::getline(ifs7, names_line)) {
+            if(names_line.empty()) {
+                continue;
+            }
+            names_ss.clear();
+            names_ss.str(names_line);
+            std::getline(names_ss, names_parent, ',');
+            std::getline(names_ss, names_alias, ',');
+            std::size_t div_pos = names_parent.find(':');
+            if(div_pos == std::string::npos) {
+                // No children are present
+                if(db_parent_name_map.count(names_parent)) {
+                    std::cerr << "ERROR: Parent chromosomes must be unique if no children are present,";
+                    std::cerr << " (duplicate detected): ";
+                    std::cerr << names_parent << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                db_parent_name_map[names_parent] = names_alias;
+                db_child_name_map[names_parent] = names_alias;
+                db_parent_map[names_parent] = std::vector< std::string > {names_parent};
+                rev_db_parent_map[names_parent] = names_parent;
+            }
+            else {
+                // Children are present
+                // names_alias format: parent_name\tchild_name
+                names_child = names_parent.substr(div_pos + 1);
+                names_parent.erase(div_pos);
+                if(db_parent_map.count(names_parent)) {
+                    db_parent_map.at(names_parent).push_back(names_child);
+                }
+                else {
+                    db_parent_map[names_parent] = std::vector< std::string > {names_child};
+                    if(rev_db_parent_map.count(names_child)) {
+                        std::cerr << "ERROR: Child chromosomes must be unique (duplicate detected): ";
+                        std::cerr << names_parent << " -> " << names_child << std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                rev_db_parent_map[names_child] = names_parent;
+                if(db_child_name_map.count(names_child)) {
+                    std::cerr << "ERROR: Child chromosomes must be unique (duplicate detected): ";
+                    std::cerr << names_parent << " -> " << names_child << ": " << names_alias << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                if(!db_parent_name_map.count(names_parent)) {
+                    std::size_t parent_found = names_alias.find_last_of(',');
+                    db_parent_name_map[names_parent] = names_alias.substr(0, parent_found - 1);
+                }
+                std::size_t child_found = names_alias.find_last_of(',');
+                db_child_name_map[names_child] = names_alias.substr(child_found + 1);
+            }
+        }
+        ifs7.close();
+    }
+
+    // Intern every string and give each accession a dense id in sorted name order
+    std::vector< std::string > strings;
+    std::unordered_map< std::string, uint32_t > string_ids;
+    auto intern = [&strings, &string_ids](const std::string &s) {
+        auto found = string_ids.find(s);
+        if(found != string_ids.end()) {
+            return found->second;
+        }
+        uint32_t id = (uint32_t)strings.size();
+        strings.push_back(s);
+        string_ids.emplace(s, id);
+        return id;
+    };
+
+    std::vector< std::string > acc_names;
+    for(auto &[acc, entries] : db_ann_map) {
+        acc_names.push_back(acc);
+    }
+    for(auto &[acc, children] : db_parent_map) {
+        acc_names.push_back(acc);
+    }
+    for(auto &[acc, parent] : rev_db_parent_map) {
+        acc_names.push_back(acc);
+    }
+    std::sort(acc_names.begin(), acc_names.end());
+    acc_names.erase(std::unique(acc_names.begin(), acc_names.end()), acc_names.end());
+    std::unordered_map< std::string, int32_t > acc_ids;
+    for(int i = 0; i < acc_names.size(); ++i) {
+        acc_ids[acc_names[i]] = i;
+    }
+
+    std::vector< DbAccession > accessions(acc_names.size());
+    std::vector< uint32_t > children;
+    std::vector< DbAnnotation > annotations;
+    for(int i = 0; i < acc_names.size(); ++i) {
+        const std::string &acc = acc_names[i];
+        DbAccession &entry = accessions[i];
+        entry.name = intern(acc);
+        entry.parent = rev_db_parent_map.count(acc) ? acc_ids.at(rev_db_parent_map.at(acc)) : -1;
+        entry.alias = db_child_name_map.count(acc) ? (int32_t)intern(db_child_name_map.at(acc)) : -1;
+        entry.parent_alias = db_parent_name_map.count(acc) ? (int32_t)intern(db_parent_name_map.at(acc)) : -1;
+        entry.first_child = children.size();
+        entry.num_children = 0;
+        if(db_parent_map.count(acc)) {
+            for(const std::string &child : db_parent_map.at(acc)) {
+                children.push_back(acc_ids.at(child));
+                entry.num_children++;
+            }
+        }
+        entry.first_ann = annotations.size();
+        entry.num_ann = 0;
+        if(db_ann_map.count(acc)) {
+            for(const std::vector< std::string > &fields : db_ann_map.at(acc)) {
+                DbAnnotation ann;
+                ann.start = _parseCoordinate(fields[0]);
+                ann.stop = _parseCoordinate(fields[1]);
+                ann.strand = (fields[2] == "+") ? 1 : ((fields[2] == "-") ? -1 : 0);
+                ann.gene = intern(fields[3]);
+                ann.product = intern(fields[4]);
+                ann.pad = 0;
+                annotations.push_back(ann);
+                entry.num_ann++;
+            }
+        }
+    }
+
+    std::vector< StringRef > string_refs;
+    std::string pool;
+    for(const std::string &s : strings) {
+        string_refs.push_back(StringRef{(uint32_t)pool.size(), (uint32_t)s.length()});
+        pool += s;
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, DB_INDEX_MAGIC, sizeof(DB_INDEX_MAGIC));
+    for(int i = 0; i < 4; ++i) {
+        header.source_stamps[i] = source_stamps[i];
+    }
+    header.num_strings = string_refs.size();
+    header.strings_offset = alignTo8(sizeof(Header));
+    header.num_accessions = accessions.size();
+    header.accessions_offset = alignTo8(header.strings_offset + (string_refs.size() * sizeof(StringRef)));
+    header.num_children = children.size();
+    header.children_offset = alignTo8(header.accessions_offset + (accessions.size() * sizeof(DbAccession)));
+    header.num_annotations = annotations.size();
+    header.annotations_offset = alignTo8(header.children_offset + (children.size() * sizeof(uint32_t)));
+    header.pool_offset = alignTo8(header.annotations_offset + (annotations.size() * sizeof(DbAnnotation)));
+    header.pool_size = pool.size();
+
+    buffer.assign(header.pool_offset + pool.size(), 0);
+    std::memcpy(buffer.data(), &header, sizeof(Header));
+    std::memcpy(buffer.data() + header.strings_offset, string_refs.data(), string_refs.size() * sizeof(StringRef));
+    std::memcpy(buffer.data() + header.accessions_offset, accessions.data(), accessions.size() * sizeof(DbAccession));
+    std::memcpy(buffer.data() + header.children_offset, children.data(), children.size() * sizeof(uint32_t));
+    std::memcpy(buffer.data() + header.annotations_offset, annotations.data(),
+                annotations.size() * sizeof(DbAnnotation));
+    std::memcpy(buffer.data() + header.pool_offset, pool.data(), pool.size());
+}
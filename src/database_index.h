@@ -0,0 +1,82 @@
+#ifndef SIMPLE_SNP_DATABASE_INDEX_H
+#define SIMPLE_SNP_DATABASE_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Compiled form of <reference_db>.ann and <reference_db>.names.  The text files are parsed once into a flat binary
+// file (<reference_db>.dbidx) holding an interned string pool, an accession table sorted by name, the ordered child
+// lists of each parent and the annotation records with numeric start/stop/strand.  Later runs mmap that file and
+// use it in place; it is rebuilt whenever the size or mtime of either source file changes.
+struct DbAccession {
+    uint32_t name;          // string id
+    int32_t parent;         // accession id of the parent, -1 if not listed in .names
+    int32_t alias;          // string id of this accession's name in .names, -1 if none
+    int32_t parent_alias;   // string id of the parent organism's name, -1 if not a parent
+    uint32_t first_child;
+    uint32_t num_children;
+    uint32_t first_ann;
+    uint32_t num_ann;
+};
+
+
+struct DbAnnotation {
+    int64_t start;
+    int64_t stop;
+    int32_t strand;         // 1 (+), -1 (-), 0 (unknown)
+    uint32_t gene;          // string id
+    uint32_t product;       // string id
+    uint32_t pad;
+};
+
+
+class DatabaseIndex {
+public:
+    DatabaseIndex();
+    ~DatabaseIndex();
+
+    DatabaseIndex(const DatabaseIndex&) = delete;
+    DatabaseIndex& operator=(const DatabaseIndex&) = delete;
+
+    void load(const std::string &ann_path, const std::string &names_path, const std::string &index_path);
+
+    int findAccession(const std::string &acc) const;
+    bool hasParent(const std::string &acc) const;
+    std::string parentOf(const std::string &acc) const;
+    std::vector< std::string > childrenOf(const std::string &parent) const;
+    std::string accessionName(const int &acc_id) const;
+    std::string stringAt(const uint32_t &string_id) const;
+
+    std::size_t numAccessions() const;
+    const DbAccession& accession(const int &acc_id) const;
+    const DbAnnotation* annotations(const int &acc_id) const;
+
+private:
+    struct Header;
+    struct StringRef;
+
+    bool _mapIndex(const std::string &index_path, const std::vector< int64_t > &source_stamps);
+    void _buildIndex(const std::string &ann_path,
+                     const std::string &names_path,
+                     const std::vector< int64_t > &source_stamps,
+                     std::vector< char > &buffer);
+    void _attach(const char* data);
+    int _compareName(const uint32_t &string_id, const std::string &name) const;
+
+    const char* _data = nullptr;
+    std::size_t _data_len = 0;
+    bool _mapped = false;
+    std::vector< char > _owned;
+
+    const Header* _header = nullptr;
+    const StringRef* _strings = nullptr;
+    const char* _pool = nullptr;
+    const DbAccession* _accessions = nullptr;
+    const uint32_t* _children = nullptr;
+    const DbAnnotation* _annotations = nullptr;
+};
+
+
+#endif //SIMPLE_SNP_DATABASE_INDEX_H
@@ -1,4 +1,5 @@
 #include "dispatch_queue.h"
+#include "task_trace.h"
 #include <iostream>
 
 
@@ -64,6 +65,7 @@ void DispatchQueue::dispatch(std::unique_ptr< ParserJob > job)
 // Private member functions
 void DispatchQueue::_dispatch_thread_handler(void)
 {
+	TaskTrace::setThreadName("Dispatcher");
 	std::unique_lock<std::mutex> lock(_lock);
 
 	do {
@@ -73,7 +75,9 @@ void DispatchQueue::_dispatch_thread_handler(void)
 			_q.pop();
 
 			lock.unlock();
+            TaskTrace::begin("Task");
             op();
+            TaskTrace::end("Task");
 			lock.lock();
 		}
 	} while(!_exit);
@@ -82,17 +86,32 @@ void DispatchQueue::_dispatch_thread_handler(void)
 
 void DispatchQueue::_job_dispatch_thread_handler(void)
 {
+    TaskTrace::setThreadName("Worker");
     std::unique_lock<std::mutex> lock(_lock);
 
+    // Job threads also run plain function objects (e.g. calling tasks) so they can share the same pool
     do {
-        _cv.wait(lock, [this]{return (_job_q.size() || _exit);});
+        _cv.wait(lock, [this]{return (_job_q.size() || _q.size() || _exit);});
         if(!_exit && _job_q.size()) {
             std::unique_ptr< ParserJob > job = std::move(_job_q.front());
             _job_q.pop();
 
             lock.unlock();
+            // The job's destructor publishes its completion, so it is part of the traced task
+            TaskTrace::begin("ParserJob", job->sam_filepath);
             job->run();
             job.reset();
+            TaskTrace::end("ParserJob");
+            lock.lock();
+        }
+        else if(!_exit && _q.size()) {
+            auto op = std::move(_q.front());
+            _q.pop();
+
+            lock.unlock();
+            TaskTrace::begin("Task");
+            op();
+            TaskTrace::end("Task");
             lock.lock();
         }
     } while(!_exit);
@@ -1,10 +1,17 @@
 #include "fasta_parser.h"
 
 #include <cassert>
+#include <cstring>
 #include <fstream>
+#include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <filesystem>
 #include <set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 FastaParser::FastaParser(const std::string &fasta_filepath) : _fasta_path(fasta_filepath)
@@ -13,44 +20,228 @@ FastaParser::FastaParser(const std::string &fasta_filepath) : _fasta_path(fasta_
 }
 
 
+FastaParser::~FastaParser()
+{
+    if(_data != nullptr) {
+        munmap((void*)_data, _data_len);
+    }
+}
+
+
+void FastaParser::indexFasta()
+{
+    // Map the FASTA and load <reference>.fai, building it first if it is missing or older than the FASTA.
+    // Safe to call from a background thread while SAM files are being parsed.
+    std::unique_lock< std::mutex > lock(_mtx);
+    if(_indexed) {
+        return;
+    }
+    _mapFasta();
+
+    std::string fai_path = _fasta_path + ".fai";
+    std::error_code ec;
+    bool fai_fresh = std::filesystem::exists(fai_path, ec)
+            && (std::filesystem::last_write_time(fai_path, ec) >= std::filesystem::last_write_time(_fasta_path, ec));
+    if(!fai_fresh || !_loadIndex(fai_path)) {
+        fasta_index.clear();
+        _buildIndex(fai_path);
+    }
+    _indexed = true;
+}
+
+
 void FastaParser::parseFasta(const std::vector< std::string > &selected_headers)
 {
-    std::ifstream ifs;
-    ifs.open(_fasta_path, std::ifstream::in);
+    indexFasta();
 
-    if(!ifs.is_open()) {
+    // Sequences are not decoded here; getSequence() pulls each contig out of the mapped file on first use
+    for(int i = 0; i < selected_headers.size(); ++i) {
+        if(!fasta_index.count(selected_headers[i])) {
+            std::cerr << "ERROR: Reference sequence not found in FASTA file " << _fasta_path << ", provided: ";
+            std::cerr << selected_headers[i] << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        headers_lens[selected_headers[i]] = fasta_index.at(selected_headers[i]).length;
+    }
+    if(selected_headers.empty()) {
+        for(auto &[name, entry] : fasta_index) {
+            headers_lens[name] = entry.length;
+        }
+    }
+}
+
+
+const PackedSequence& FastaParser::getSequence(const std::string &header)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    auto found = headers_seqs.find(header);
+    if(found != headers_seqs.end()) {
+        return found->second;
+    }
+
+    const FastaIndexEntry &entry = fasta_index.at(header);
+    PackedSequence seq;
+    seq.reserve(entry.length);
+    const char* p = _data + entry.offset;
+    const char* end = _data + _data_len;
+    while((seq.length() < entry.length) && (p < end)) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if(eol == nullptr) {
+            eol = end;
+        }
+        const char* line_end = eol;
+        if((line_end > p) && (*(line_end - 1) == '\r')) {
+            line_end--;
+        }
+        seq.append(p, std::min((long)(line_end - p), entry.length - seq.length()));
+        p = eol + 1;
+    }
+    return headers_seqs.emplace(header, std::move(seq)).first->second;
+}
+
+
+// Private member functions
+void FastaParser::_mapFasta()
+{
+    int fd = open(_fasta_path.c_str(), O_RDONLY);
+    if(fd < 0) {
         std::cerr << "ERROR: Could not open FASTA file " << _fasta_path << std::endl;
         std::exit(EXIT_FAILURE);
     }
+    struct stat sb;
+    if((fstat(fd, &sb) != 0) || (sb.st_size == 0)) {
+        std::cerr << "ERROR: FASTA file is empty or unreadable: " << _fasta_path << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    _data_len = sb.st_size;
+    void* addr = mmap(nullptr, _data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        std::cerr << "ERROR: Could not memory map FASTA file " << _fasta_path << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    _data = (const char*)addr;
+}
 
-    std::set< std::string > selects(selected_headers.begin(), selected_headers.end());
 
-    std::string temp_line;
-    std::getline(ifs, temp_line);
-    while(ifs.good()) {
-        if(temp_line[0] != '>') {
-            std::cerr << "ERROR: FASTA file headers must begin with >, provided: " << temp_line << std::endl;
+bool FastaParser::_loadIndex(const std::string &fai_path)
+{
+    std::ifstream ifs(fai_path, std::ios::in);
+    if(!ifs.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    std::stringstream ss;
+    while(std::getline(ifs, line)) {
+        if(line.empty()) {
+            continue;
+        }
+        ss.clear();
+        ss.str(line);
+        FastaIndexEntry entry;
+        if(!(ss >> entry.name >> entry.length >> entry.offset >> entry.line_bases >> entry.line_width)) {
+            return false;
+        }
+        if((entry.length < 0) || (entry.line_bases <= 0) || (entry.line_width < entry.line_bases)
+           || ((entry.offset + entry.length) > (long)_data_len)) {
+            return false;
+        }
+        if(fasta_index.count(entry.name)) {
+            std::cerr << "ERROR: FASTA headers must be unqiue, duplicated provided: " << entry.name << std::endl;
             std::exit(EXIT_FAILURE);
         }
-        header = "";
-        seq = "";
+        fasta_index[entry.name] = entry;
+    }
+    return true;
+}
+
 
-        header = temp_line.substr(1, temp_line.find(' ') - 1);
-        std::getline(ifs, temp_line);
-        while((!ifs.eof()) && (temp_line[0] != '>')) {
-            seq += temp_line;
-            std::getline(ifs, temp_line);
+void FastaParser::_buildIndex(const std::string &fai_path)
+{
+    // Single pass over the mapped file recording the same fields samtools faidx writes.  Contigs with ragged line
+    // lengths are still indexed for getSequence(), but the .fai is only written if every contig is regular.
+    madvise((void*)_data, _data_len, MADV_SEQUENTIAL);
+    std::vector< FastaIndexEntry > ordered_entries;
+    bool all_regular = true;
+    const char* p = _data;
+    const char* end = _data + _data_len;
+    while(p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if(eol == nullptr) {
+            eol = end;
+        }
+        if(eol == p || ((eol - p) == 1 && *p == '\r')) {
+            p = eol + 1;
+            continue;
         }
-        if(headers_seqs.count(header)) {
-            std::cerr << "ERROR: FASTA headers must be unqiue, duplicated provided: " << header << std::endl;
+        if(*p != '>') {
+            std::cerr << "ERROR: FASTA file headers must begin with >, provided: " << std::string(p, eol) << std::endl;
             std::exit(EXIT_FAILURE);
         }
-        if((!selects.empty()) and (!selects.count(header))) {
-            continue;
+        const char* name_end = p + 1;
+        while((name_end < eol) && (*name_end != ' ') && (*name_end != '\t') && (*name_end != '\r')) {
+            name_end++;
         }
-        headers_seqs[header] = seq;
-        headers_lens[header] = (long)seq.length();
+
+        FastaIndexEntry entry;
+        entry.name = std::string(p + 1, name_end);
+        entry.length = 0;
+        entry.offset = (eol + 1) - _data;
+        entry.line_bases = 0;
+        entry.line_width = 0;
+        if(fasta_index.count(entry.name)) {
+            std::cerr << "ERROR: FASTA headers must be unqiue, duplicated provided: " << entry.name << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        bool short_line_seen = false;
+        p = eol + 1;
+        while((p < end) && (*p != '>')) {
+            eol = (const char*)memchr(p, '\n', end - p);
+            if(eol == nullptr) {
+                eol = end;
+            }
+            long width = (eol - p) + ((eol < end) ? 1 : 0);
+            long bases = eol - p;
+            if((bases > 0) && (*(eol - 1) == '\r')) {
+                bases--;
+            }
+            if(bases > 0) {
+                if(entry.line_bases == 0) {
+                    entry.line_bases = bases;
+                    entry.line_width = width;
+                }
+                else if(short_line_seen || (bases > entry.line_bases)) {
+                    all_regular = false;
+                }
+                if(bases < entry.line_bases) {
+                    short_line_seen = true;
+                }
+                entry.length += bases;
+            }
+            p = eol + 1;
+        }
+        if(entry.line_bases == 0) {
+            entry.line_bases = 1;
+            entry.line_width = 1;
+        }
+        fasta_index[entry.name] = entry;
+        ordered_entries.push_back(entry);
     }
 
-    ifs.close();
+    if(!all_regular) {
+        std::cerr << "WARNING: FASTA file has irregular line lengths, not writing index: " << fai_path << std::endl;
+        return;
+    }
+    std::ofstream ofs(fai_path);
+    if(!ofs.is_open()) {
+        // Read-only reference directory; the in-memory index is still usable for this run
+        return;
+    }
+    for(int i = 0; i < ordered_entries.size(); ++i) {
+        ofs << ordered_entries[i].name << '\t' << ordered_entries[i].length << '\t' << ordered_entries[i].offset;
+        ofs << '\t' << ordered_entries[i].line_bases << '\t' << ordered_entries[i].line_width << std::endl;
+    }
+    ofs.close();
 }
@@ -3,21 +3,43 @@
 
 #include <vector>
 #include <string>
+#include <mutex>
 #include <unordered_map>
+#include "packed_sequence.h"
+
+
+// One .fai record: { name, length, byte offset of first base, bases per line, bytes per line }
+struct FastaIndexEntry {
+    std::string name;
+    long length;
+    long offset;
+    long line_bases;
+    long line_width;
+};
 
 
 class FastaParser {
 public:
     FastaParser(const std::string &fasta_filepath);
+    ~FastaParser();
 
+    void indexFasta();
     void parseFasta(const std::vector< std::string > &selected_headers);
+    const PackedSequence& getSequence(const std::string &header);
 
-    std::string header;
-    std::string seq;
-    std::unordered_map< std::string, std::string > headers_seqs;
+    std::unordered_map< std::string, PackedSequence > headers_seqs;
     std::unordered_map< std::string, long > headers_lens;
+    std::unordered_map< std::string, FastaIndexEntry > fasta_index;
 private:
+    void _mapFasta();
+    bool _loadIndex(const std::string &fai_path);
+    void _buildIndex(const std::string &fai_path);
+
     std::string _fasta_path;
+    const char* _data = nullptr;
+    std::size_t _data_len = 0;
+    bool _indexed = false;
+    std::mutex _mtx;
 };
 
 
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <string.h>
+#include <sys/stat.h>
 
 
 FileFinder::FileFinder()
@@ -14,11 +15,26 @@ FileFinder::FileFinder()
 std::vector< std::string > FileFinder::findSamFiles(const std::string &input_path)
 {
     std::vector< std::string > return_files;
+
+    // A single input: stdin, a named pipe or one (possibly gzip-compressed) SAM file
+    struct stat sb;
+    if((input_path == "-") || ((stat(input_path.c_str(), &sb) == 0) && !S_ISDIR(sb.st_mode))) {
+        return_files.push_back(input_path);
+        return return_files;
+    }
+
     glob_t glob_result;
     memset(&glob_result, 0, sizeof(glob_result));
 
     std::string glob_pattern = input_path + "/*.sam";
     int return_value = glob(glob_pattern.c_str(), GLOB_TILDE, NULL, &glob_result);
+    if(return_value == 0 || return_value == 3) {
+        glob_pattern = input_path + "/*.sam.gz";
+        int gz_return_value = glob(glob_pattern.c_str(), GLOB_TILDE | GLOB_APPEND, NULL, &glob_result);
+        if(return_value == 3 || gz_return_value != 3) {
+            return_value = gz_return_value;
+        }
+    }
     if(return_value != 0 && return_value != 3) {
         globfree(&glob_result);
         std::cerr << "findSamFiles() glob() failed with return value: " << return_value << std::endl;
@@ -26,7 +42,7 @@ std::vector< std::string > FileFinder::findSamFiles(const std::string &input_pat
     }
     else if(return_value == 3) {
         std::cerr << std::endl << "The specified input directory (" << input_path;
-        std::cerr << ") contains no detectable SAM files with extension .sam" << std::endl << std::endl;
+        std::cerr << ") contains no detectable SAM files with extension .sam or .sam.gz" << std::endl << std::endl;
         std::exit(EXIT_FAILURE);
     }
     else if(return_value == 0) {
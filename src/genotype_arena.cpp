@@ -0,0 +1,33 @@
+#include "genotype_arena.h"
+
+
+void GenotypeArena::clear()
+{
+    _data.clear();
+    _ends.clear();
+}
+
+
+std::string& GenotypeArena::field()
+{
+    return _data;
+}
+
+
+void GenotypeArena::endField()
+{
+    _ends.push_back(_data.size());
+}
+
+
+int GenotypeArena::size() const
+{
+    return _ends.size();
+}
+
+
+std::string_view GenotypeArena::operator[](const int &idx) const
+{
+    std::size_t start = (idx > 0) ? _ends[idx - 1] : 0;
+    return std::string_view(_data.data() + start, _ends[idx] - start);
+}
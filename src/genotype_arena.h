@@ -0,0 +1,30 @@
+#ifndef SIMPLE_SNP_GENOTYPE_ARENA_H
+#define SIMPLE_SNP_GENOTYPE_ARENA_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// The per-sample genotype fields of one variant site, back to back in one flat buffer.  Fields are written in
+// sample order: append to field(), then endField() closes it and the next one starts.  clear() keeps the capacity,
+// so once the buffer has grown to the widest site seen, filling it allocates nothing.
+class GenotypeArena {
+public:
+    void clear();
+
+    // The buffer the open field is appended to
+    std::string& field();
+    void endField();
+
+    int size() const;
+    std::string_view operator[](const int &idx) const;
+
+private:
+    std::string _data;
+    // End offset of each closed field in _data
+    std::vector< std::size_t > _ends;
+};
+
+
+#endif //SIMPLE_SNP_GENOTYPE_ARENA_H
@@ -0,0 +1,364 @@
+#include "input_prefetcher.h"
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+InputPrefetcher::InputPrefetcher(const std::vector< std::string > &sam_files,
+                                 const int &depth,
+                                 const long &max_file_bytes,
+                                 const bool &use_uring)
+                                 : _depth(depth), _max_file_bytes(max_file_bytes)
+{
+    _files.resize(sam_files.size());
+    for(int i = 0; i < sam_files.size(); ++i) {
+        _files[i].path = sam_files[i];
+        _file_idxs[sam_files[i]] = i;
+    }
+
+    unsigned entries = 1;
+    while(entries < _depth) {
+        entries <<= 1;
+    }
+    if(use_uring) {
+        _setupUring(entries);
+    }
+    _prefetch_thread = std::thread(&InputPrefetcher::_run, this);
+}
+
+
+InputPrefetcher::~InputPrefetcher()
+{
+    {
+        std::unique_lock< std::mutex > lock(_mtx);
+        _stop = true;
+    }
+    _cv.notify_all();
+    _prefetch_thread.join();
+    for(PrefetchFile &file : _files) {
+        if(file.fd >= 0) {
+            close(file.fd);
+        }
+    }
+    _teardownUring();
+}
+
+
+bool InputPrefetcher::take(const std::string &sam_filepath, std::vector< char > &contents)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    auto found = _file_idxs.find(sam_filepath);
+    if(found == _file_idxs.end()) {
+        return false;
+    }
+    PrefetchFile &file = _files[found->second];
+    if(file.state == FileState::pending) {
+        // The parser got here before the prefetch thread did, so it reads the file itself
+        file.state = FileState::skipped;
+        return false;
+    }
+    _cv.wait(lock, [&file] () {return (file.state != FileState::reading);});
+    if(file.state != FileState::ready) {
+        return false;
+    }
+    contents = std::move(file.contents);
+    file.state = FileState::taken;
+    _window--;
+    _cv.notify_all();
+    return true;
+}
+
+
+void InputPrefetcher::discard(const std::string &sam_filepath)
+{
+    std::vector< char > contents;
+    take(sam_filepath, contents);
+}
+
+
+bool InputPrefetcher::usingUring() const
+{
+    return _ring_fd >= 0;
+}
+
+
+void InputPrefetcher::_run()
+{
+    int next = 0;
+    while(true) {
+        // Start reads until the window is full
+        while(true) {
+            int idx = -1;
+            {
+                std::unique_lock< std::mutex > lock(_mtx);
+                while((next < _files.size()) && (_files[next].state != FileState::pending)) {
+                    next++;
+                }
+                if(!_stop && (next < _files.size()) && (_window < _depth)) {
+                    idx = next++;
+                    _files[idx].state = FileState::reading;
+                    _window++;
+                }
+            }
+            if(idx < 0) {
+                break;
+            }
+
+            PrefetchFile &file = _files[idx];
+            if(!_open(file)) {
+                _finish(idx, false);
+            }
+            else if(file.size == 0) {
+                _finish(idx, true);
+            }
+            else if(_ring_fd >= 0) {
+                _submitRead(idx);
+            }
+            else {
+                _finish(idx, _preadRest(file));
+            }
+        }
+
+        // Submit the batch and wait for at least one read, or for a parser to free a window slot
+        if(_in_flight > 0) {
+            // The kernel stops submitting at an entry it rejects (its completion carries the error), so entries
+            // behind it stay queued for the next call
+            int submitted = _enterUring(_pending_submissions, 1);
+            if(submitted > 0) {
+                _pending_submissions -= submitted;
+            }
+            _reapCompletions();
+            continue;
+        }
+        std::unique_lock< std::mutex > lock(_mtx);
+        if(_stop) {
+            return;
+        }
+        while((next < _files.size()) && (_files[next].state != FileState::pending)) {
+            next++;
+        }
+        if(next == _files.size()) {
+            return;
+        }
+        _cv.wait(lock, [this] () {return (_stop || (_window < _depth));});
+    }
+}
+
+
+bool InputPrefetcher::_open(PrefetchFile &file)
+{
+    struct stat sb;
+    if((stat(file.path.c_str(), &sb) != 0) || !S_ISREG(sb.st_mode) || (sb.st_size > _max_file_bytes)) {
+        return false;
+    }
+    file.fd = open(file.path.c_str(), O_RDONLY);
+    if(file.fd < 0) {
+        return false;
+    }
+    file.size = sb.st_size;
+    file.contents.resize(file.size);
+    return true;
+}
+
+
+bool InputPrefetcher::_preadRest(PrefetchFile &file)
+{
+    while(file.done < file.size) {
+        ssize_t n = pread(file.fd, file.contents.data() + file.done, file.size - file.done, file.done);
+        if(n <= 0) {
+            return false;
+        }
+        file.done += n;
+    }
+    return true;
+}
+
+
+void InputPrefetcher::_finish(const int &idx, const bool &success)
+{
+    PrefetchFile &file = _files[idx];
+    if(file.fd >= 0) {
+        close(file.fd);
+        file.fd = -1;
+    }
+    std::unique_lock< std::mutex > lock(_mtx);
+    if(success) {
+        file.state = FileState::ready;
+    }
+    else {
+        file.state = FileState::skipped;
+        file.contents = std::vector< char >();
+        _window--;
+    }
+    _cv.notify_all();
+}
+
+
+bool InputPrefetcher::_setupUring(const unsigned &entries)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    _ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if(_ring_fd < 0) {
+        return false;
+    }
+
+    _sq_ring_bytes = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+    _cq_ring_bytes = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single_mmap) {
+        _sq_ring_bytes = std::max(_sq_ring_bytes, _cq_ring_bytes);
+        _cq_ring_bytes = 0;
+    }
+    _sq_ptr = mmap(nullptr, _sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd,
+                   IORING_OFF_SQ_RING);
+    if(_sq_ptr == MAP_FAILED) {
+        _sq_ptr = nullptr;
+        _teardownUring();
+        return false;
+    }
+    _cq_ptr = _sq_ptr;
+    if(!single_mmap) {
+        _cq_ptr = mmap(nullptr, _cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd,
+                       IORING_OFF_CQ_RING);
+        if(_cq_ptr == MAP_FAILED) {
+            _cq_ptr = nullptr;
+            _teardownUring();
+            return false;
+        }
+    }
+    _sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes_ptr = mmap(nullptr, _sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd,
+                     IORING_OFF_SQES);
+    if(_sqes_ptr == MAP_FAILED) {
+        _sqes_ptr = nullptr;
+        _teardownUring();
+        return false;
+    }
+
+    _sq_tail = (unsigned*)((char*)_sq_ptr + params.sq_off.tail);
+    _sq_mask = (unsigned*)((char*)_sq_ptr + params.sq_off.ring_mask);
+    _sq_array = (unsigned*)((char*)_sq_ptr + params.sq_off.array);
+    _cq_head = (unsigned*)((char*)_cq_ptr + params.cq_off.head);
+    _cq_tail = (unsigned*)((char*)_cq_ptr + params.cq_off.tail);
+    _cq_mask = (unsigned*)((char*)_cq_ptr + params.cq_off.ring_mask);
+    _cqes = (char*)_cq_ptr + params.cq_off.cqes;
+
+    if(!_uringSupportsRead()) {
+        _teardownUring();
+        return false;
+    }
+    return true;
+}
+
+
+bool InputPrefetcher::_uringSupportsRead()
+{
+    // IORING_OP_READ arrived in Linux 5.6: on 5.1-5.5 the ring sets up, but every read would complete with -EINVAL.
+    // The opcode probe is 5.6+ too, so a kernel that cannot answer it cannot do the read either.
+    const unsigned num_ops = 256;
+    std::vector< char > probe_buf(sizeof(struct io_uring_probe) + (num_ops * sizeof(struct io_uring_probe_op)), 0);
+    struct io_uring_probe* probe = (struct io_uring_probe*)probe_buf.data();
+    if(syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PROBE, probe, num_ops) < 0) {
+        return false;
+    }
+    return (probe->ops_len > IORING_OP_READ) && ((probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0);
+}
+
+
+void InputPrefetcher::_teardownUring()
+{
+    if(_sqes_ptr != nullptr) {
+        munmap(_sqes_ptr, _sqes_bytes);
+    }
+    if((_cq_ptr != nullptr) && (_cq_ptr != _sq_ptr)) {
+        munmap(_cq_ptr, _cq_ring_bytes);
+    }
+    if(_sq_ptr != nullptr) {
+        munmap(_sq_ptr, _sq_ring_bytes);
+    }
+    _sqes_ptr = nullptr;
+    _cq_ptr = nullptr;
+    _sq_ptr = nullptr;
+    if(_ring_fd >= 0) {
+        close(_ring_fd);
+        _ring_fd = -1;
+    }
+}
+
+
+void InputPrefetcher::_submitRead(const int &idx)
+{
+    // One read for the rest of the file; short reads are resubmitted from _reapCompletions().  The submission
+    // queue has a slot per window entry, so it never overflows.
+    PrefetchFile &file = _files[idx];
+    unsigned tail = *_sq_tail;
+    unsigned slot = tail & *_sq_mask;
+    struct io_uring_sqe* sqe = (struct io_uring_sqe*)_sqes_ptr + slot;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file.fd;
+    sqe->addr = (unsigned long)(file.contents.data() + file.done);
+    sqe->len = (unsigned)std::min(file.size - file.done, (long)1 << 30);
+    sqe->off = file.done;
+    sqe->user_data = idx;
+    _sq_array[slot] = slot;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    _pending_submissions++;
+    _in_flight++;
+}
+
+
+int InputPrefetcher::_enterUring(const unsigned &to_submit, const unsigned &min_complete)
+{
+    int ret;
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete, IORING_ENTER_GETEVENTS,
+                           nullptr, 0);
+    } while((ret < 0) && (errno == EINTR));
+    return ret;
+}
+
+
+int InputPrefetcher::_reapCompletions()
+{
+    int num_reaped = 0;
+    unsigned head = *_cq_head;
+    unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    while(head != tail) {
+        struct io_uring_cqe* cqe = (struct io_uring_cqe*)_cqes + (head & *_cq_mask);
+        int idx = (int)cqe->user_data;
+        int res = cqe->res;
+        head++;
+        _in_flight--;
+        num_reaped++;
+
+        PrefetchFile &file = _files[idx];
+        if(res < 0) {
+            // Whatever the ring could not read (e.g. -EINVAL from an opcode the probe did not rule out) is read
+            // with pread rather than sent back to the parser
+            _finish(idx, _preadRest(file));
+            continue;
+        }
+        if(res == 0) {
+            // The file shrank since it was sized
+            _finish(idx, false);
+            continue;
+        }
+        file.done += res;
+        if(file.done < file.size) {
+            _submitRead(idx);
+        }
+        else {
+            _finish(idx, true);
+        }
+    }
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+    return num_reaped;
+}
@@ -0,0 +1,96 @@
+#ifndef SIMPLE_SNP_INPUT_PREFETCHER_H
+#define SIMPLE_SNP_INPUT_PREFETCHER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+// Batched read-ahead of whole small SAM files for cohorts of many files.  A prefetch thread keeps the next `depth`
+// files of the parse order in flight: it opens them and submits one large read per file to an io_uring, so the
+// open/read syscalls of many parsers collapse into a few batched submissions, and hands finished buffers to the
+// ParserJobs that take() them.  Where io_uring is unavailable (kernel before 5.6, which lacks IORING_OP_READ, or
+// blocked by seccomp) or not requested, the same thread reads the files with pread instead, as it does for any read
+// the ring fails.  Files larger than max_file_bytes, stdin and named pipes
+// are left to SamReader.
+class InputPrefetcher {
+public:
+    InputPrefetcher(const std::vector< std::string > &sam_files,
+                    const int &depth,
+                    const long &max_file_bytes,
+                    const bool &use_uring);
+    ~InputPrefetcher();
+
+    // Move the whole contents of sam_filepath into contents, waiting for its read if it is in flight.  Returns
+    // false if the file is not prefetched (too large, unreadable, or not reached yet), in which case the caller
+    // reads it itself.
+    bool take(const std::string &sam_filepath, std::vector< char > &contents);
+
+    // Release the prefetch of a file that will not be read (e.g. its pileup was cached)
+    void discard(const std::string &sam_filepath);
+
+    bool usingUring() const;
+
+    InputPrefetcher(const InputPrefetcher& rhs) = delete;
+    InputPrefetcher& operator=(const InputPrefetcher& rhs) = delete;
+
+private:
+    enum class FileState { pending, reading, ready, taken, skipped };
+
+    struct PrefetchFile {
+        std::string path;
+        FileState state = FileState::pending;
+        int fd = -1;
+        long size = 0;
+        long done = 0;
+        std::vector< char > contents;
+    };
+
+    void _run();
+    bool _open(PrefetchFile &file);
+    bool _preadRest(PrefetchFile &file);
+    void _finish(const int &idx, const bool &success);
+
+    // io_uring submission and completion (raw syscalls; liburing is not required)
+    bool _setupUring(const unsigned &entries);
+    bool _uringSupportsRead();
+    void _teardownUring();
+    void _submitRead(const int &idx);
+    int _enterUring(const unsigned &to_submit, const unsigned &min_complete);
+    int _reapCompletions();
+
+    std::vector< PrefetchFile > _files;
+    std::unordered_map< std::string, int > _file_idxs;
+    int _depth;
+    long _max_file_bytes;
+
+    std::thread _prefetch_thread;
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    bool _stop = false;
+    // Files reading or ready but not yet taken
+    int _window = 0;
+
+    int _ring_fd = -1;
+    void* _sq_ptr = nullptr;
+    void* _cq_ptr = nullptr;
+    void* _sqes_ptr = nullptr;
+    std::size_t _sq_ring_bytes = 0;
+    std::size_t _cq_ring_bytes = 0;
+    std::size_t _sqes_bytes = 0;
+    unsigned* _sq_tail = nullptr;
+    unsigned* _sq_mask = nullptr;
+    unsigned* _sq_array = nullptr;
+    unsigned* _cq_head = nullptr;
+    unsigned* _cq_tail = nullptr;
+    unsigned* _cq_mask = nullptr;
+    void* _cqes = nullptr;
+    unsigned _pending_submissions = 0;
+    int _in_flight = 0;
+};
+
+
+#endif //SIMPLE_SNP_INPUT_PREFETCHER_H
@@ -1,9 +1,7 @@
 #include "large_indel_finder.h"
-#include "IntervalTree.h"
+#include "pileup_spill.h"
 #include <limits>
-
-
-typedef IntervalTree<long, int> ITree;
+#include <set>
 
 
 LargeIndelFinder::LargeIndelFinder(Args &args) : _args(args)
@@ -12,138 +10,88 @@ LargeIndelFinder::LargeIndelFinder(Args &args) : _args(args)
 }
 
 
-void LargeIndelFinder::findLargeIndels(const std::unordered_map< std::string,
-                                       std::unordered_map< std::string,
-                                       std::vector< std::vector< int > > > > &nucleotide_counts)
+void LargeIndelFinder::findLargeIndels(ConcurrentBufferQueue* buffer_q)
 {
+    StageTimer timer(buffer_q->metrics, RunMetrics::large_indel_scan);
     // Find candidate ranges in each sample and order them by ascending size in a vector
     // Write this list out
     std::ofstream ofs1(_args.output_dir + "/large_indels.csv");
     ofs1 << "Sample,Reference,ReferenceAvgCoverage,Type,Start,Stop,RegionAvgCoverage,LeftBorderSharp,RightBorderSharp";
     ofs1 << std::endl;
 
-    int range_idx = 0;
     std::vector< GenomicRange > all_ranges;
-    for(auto &[sample, ref_map] : nucleotide_counts) {
-        for(auto &[this_ref, nucl] : ref_map) {
-            long total_ref_depth = 0;
-            for(int i = 0; i < nucl.size(); ++i) {
-                for(int j = 0; j < nucl[i].size(); ++j) {
-                    total_ref_depth += nucl[i][j];
+    if(buffer_q->spill_dir.empty()) {
+        for(int s = 0; s < buffer_q->all_pileups.size(); ++s) {
+            for(int r = 0; r < buffer_q->all_pileups[s].size(); ++r) {
+                if(buffer_q->all_pileups[s][r]) {
+                    _findSampleRanges(buffer_q->sample_names.name(s),
+                                      buffer_q->ref_names.name(r),
+                                      buffer_q->all_pileups[s][r]->nucleotide_counts,
+                                      ofs1,
+                                      all_ranges);
                 }
             }
-            double avg_ref_cov = (double)total_ref_depth / (double)nucl[0].size();
-            std::string out_prefix = sample + ',' + this_ref + ',' + std::to_string(avg_ref_cov) + ',';
-            std::vector< std::pair< long, long > > ref_ranges;
-            std::vector< double > region_covs;
-            std::vector< bool > range_high_confidence;
-            _determineRanges(out_prefix, nucl, ofs1, ref_ranges, region_covs, range_high_confidence);
-            for(int r = 0; r < ref_ranges.size(); ++r) {
-                GenomicRange this_range(range_idx,
-                                        range_idx,
-                                        this_ref,
-                                        ref_ranges[r].first,
-                                        ref_ranges[r].second,
-                                        this_range.stop - this_range.start + 1,
-                                        range_high_confidence[r]);
-                range_idx++;
-                all_ranges.push_back(this_range);
+        }
+    }
+    else {
+        // Only total depth is needed, so one sample/reference at a time is read back as a single depth row
+        std::vector< PagedArray< int > > depth(1);
+        for(int s = 0; s < buffer_q->all_spills.size(); ++s) {
+            for(int r = 0; r < buffer_q->all_spills[s].size(); ++r) {
+                if(buffer_q->all_spills[s][r].empty()) {
+                    continue;
+                }
+                PileupSpillReader reader(buffer_q->all_spills[s][r]);
+                reader.readDepths(buffer_q->ref_names.name(r), depth[0]);
+                _findSampleRanges(buffer_q->sample_names.name(s), buffer_q->ref_names.name(r), depth, ofs1, all_ranges);
             }
         }
     }
-    std::sort(all_ranges.begin(), all_ranges.end());
+    buffer_q->metrics.bytes_written += (long)ofs1.tellp();
     ofs1.close();
 
-    // Tabling the below section for now, probably easier to do in R
-//
-//    // Pop the smallest range, insert other ranges into the interval tree, extract intersecting
-//    // ranges, re-build the prio vector with updated ranges, and repeat until all ranges have been consumed.
-//    std::unordered_map< int, bool > parent_range_confidence_map;
-//    for(int i = 0; i < all_ranges.size(); ++i) {
-//        parent_range_confidence_map[all_ranges[i].parent_id] = all_ranges[i].high_confidence;
-//    }
-//    while(!all_ranges.empty()) {
-//        std::unordered_map< int, int > child_range_idx_map;
-//        long query_start = all_ranges[0].start;
-//        long query_stop = all_ranges[0].stop;
-//        for(int i = 0; i < all_ranges.size(); ++i) {
-//            child_range_idx_map[all_ranges[i].id] = i;
-//        }
-//        ITree::interval_vector interval_vec;
-//        for(int i = 1; i < all_ranges.size(); ++i) {
-//            interval_vec.push_back(ITree::interval(all_ranges[i].start, all_ranges[i].stop, all_ranges[i].id));
-//        }
-//        IntervalTree<long, int> interval_tree(std::move(interval_vec));
-//
-//        ITree::interval_vector results = interval_tree.findOverlapping(all_ranges[0].start, all_ranges[0].stop);
-//        std::cout << "Query: " << all_ranges[0].start << ", " << all_ranges[0].stop << "\tSize: " << results.size() << std::endl;
-//
-//        // If the query is non-overlapping, extract and continue
-//        if(results.size() == 0) {
-//            // TODO
-//            continue;
-//        }
-//
-//        // Excise the query range, reformat the intersecting ranges, fill the range vector, and repeat
-//        range_idx = 0;
-//        std::vector< GenomicRange > new_all_ranges;
-//
-//        // First pass determines the nature of the overlaps detected by the interval tree
-//        long from_right_min_idx = std::numeric_limits<long>max();
-//        long from_left_max_idx = -1;
-//        for(int i = 0; i < results.size(); ++i) {
-//            if((results[i].start > query_start) && (results[i].start < from_right_min_idx)) {
-//                from_right_min_idx = results[i].start;
-//            }
-//            if((results[i].stop < query_stop) && (results[i].stop > from_left_max_idx)) {
-//                from_left_max_idx = results[i].stop;
-//            }
-//        }
-//        if((from_left_max_idx < query_start) && (from_right_min_idx > query_stop)) {
-//            // The query is entirely contained within the result intervals
-//            std::string feature_name =
-//        }
-//        else {
-//            if((from_left_max_idx > query_start) && (from_right_min_idx < query_stop)) {
-//                // The query is partially overlapped from both sides: split into three queries and requeue
-//                // TODO
-//            }
-//            else if((from_left_max_idx > query_start) && (from_right_min_idx > query_stop)) {
-//                // The query is partially overlapped from the left only: split into two queries and requeue
-//            }
-//            else if((from_left_max_idx < query_start) && (from_right_min_idx < query_stop)) {
-//                // The query is partially overlapped from the right only: split into two queries and requeue
-//            }
-//        }
-//
-//        for(int i = 0; i < results.size(); ++i) {
-//            std::cout << '\t' << results[i].start << ", " << results[i].stop << ", " << results[i].value << std::endl;
-//            bool left_overhang = results[i].start < all_ranges[0].start;
-//            bool right_overhang = results[i].stop > all_ranges[0].stop;
-//            if(left_overhang) {
-//                GenomicRange this_range(all_ranges[child_range_idx_map[results[i].value]]);
-//                this_range.id = range_idx++;
-//                this_range.stop = results[i].start - 1;
-//                this_range.size = this_range.stop - this_range.start + 1;
-//                new_all_ranges.push_back(this_range);
-//            }
-//            if(right_overhang) {
-//                GenomicRange this_range(all_ranges[child_range_idx_map[results[i].value]]);
-//                this_range.id = range_idx++;
-//                this_range.start = results[i].stop + 1;
-//                this_range.size = this_range.stop - this_range.start + 1;
-//                new_all_ranges.push_back(this_range);
-//            }
-//            if(left_overhang && right_overhang) {
-//
-//            }
-//        }
-//    }
+    // Merge overlapping ranges across samples into cohort-level events and write them out
+    std::vector< std::vector< GenomicRange > > events;
+    _clusterRanges(all_ranges, events);
+    buffer_q->metrics.bytes_written += _writeEvents(events);
+}
+
+
+void LargeIndelFinder::_findSampleRanges(const std::string &sample,
+                                         const std::string &this_ref,
+                                         const std::vector< PagedArray< int > > &nucl,
+                                         std::ofstream &this_ofs,
+                                         std::vector< GenomicRange > &all_ranges)
+{
+    long total_ref_depth = 0;
+    for(int i = 0; i < nucl.size(); ++i) {
+        for(int j = 0; j < nucl[i].size(); ++j) {
+            total_ref_depth += nucl[i][j];
+        }
+    }
+    double avg_ref_cov = (double)total_ref_depth / (double)nucl[0].size();
+    std::string out_prefix = sample + ',' + this_ref + ',' + std::to_string(avg_ref_cov) + ',';
+    std::vector< std::pair< long, long > > ref_ranges;
+    std::vector< double > region_covs;
+    std::vector< bool > range_high_confidence;
+    _determineRanges(out_prefix, nucl, this_ofs, ref_ranges, region_covs, range_high_confidence);
+    for(int r = 0; r < ref_ranges.size(); ++r) {
+        int range_idx = all_ranges.size();
+        GenomicRange this_range(range_idx,
+                                range_idx,
+                                sample,
+                                this_ref,
+                                ref_ranges[r].first,
+                                ref_ranges[r].second,
+                                ref_ranges[r].second - ref_ranges[r].first + 1,
+                                range_high_confidence[r]);
+        all_ranges.push_back(this_range);
+    }
 }
 
 
 void LargeIndelFinder::_determineRanges(const std::string &out_prefix,
-                                        const std::vector< std::vector< int > > &nucl,
+                                        const std::vector< PagedArray< int > > &nucl,
                                         std::ofstream &this_ofs,
                                         std::vector< std::pair< long, long > > &ranges,
                                         std::vector< double > &coverages,
@@ -284,6 +232,82 @@ void LargeIndelFinder::_determineRanges(const std::string &out_prefix,
         }
     }
 }
-#pragma clang diagnostic pop
 
-#pragma clang diagnostic pop
\ No newline at end of file
+
+void LargeIndelFinder::_clusterRanges(std::vector< GenomicRange > &all_ranges,
+                                      std::vector< std::vector< GenomicRange > > &events)
+{
+    // Sweep over ranges ordered by reference and start; a range joins the open event if it begins at or before
+    // the furthest stop seen so far in that event, otherwise a new event is opened.  O(n log n) for the sort.
+    std::sort(all_ranges.begin(), all_ranges.end(), [](const GenomicRange &a, const GenomicRange &b) {
+        if(a.ref != b.ref) {
+            return a.ref < b.ref;
+        }
+        if(a.start != b.start) {
+            return a.start < b.start;
+        }
+        return a.stop < b.stop;
+    });
+
+    long event_stop = -1;
+    for(int i = 0; i < all_ranges.size(); ++i) {
+        if(events.empty() || (all_ranges[i].ref != events.back().back().ref) || (all_ranges[i].start > event_stop)) {
+            events.push_back(std::vector< GenomicRange >());
+            event_stop = all_ranges[i].stop;
+        }
+        else {
+            event_stop = std::max(event_stop, all_ranges[i].stop);
+        }
+        all_ranges[i].parent_id = events.size() - 1;
+        events.back().push_back(all_ranges[i]);
+    }
+}
+
+
+long LargeIndelFinder::_writeEvents(const std::vector< std::vector< GenomicRange > > &events)
+{
+    std::ofstream ofs(_args.output_dir + "/large_indel_events.csv");
+    ofs << "EventID,Reference,Type,Start,Stop,ConsensusStart,ConsensusStop,NumSamples,NumHighConfidence,Samples";
+    ofs << std::endl;
+
+    for(int e = 0; e < events.size(); ++e) {
+        const std::vector< GenomicRange > &members = events[e];
+        std::vector< long > starts, stops;
+        std::set< std::string > samples;
+        long event_start = members[0].start;
+        long event_stop = members[0].stop;
+        int num_high_confidence = 0;
+        for(int i = 0; i < members.size(); ++i) {
+            starts.push_back(members[i].start);
+            stops.push_back(members[i].stop);
+            samples.insert(members[i].sample);
+            event_start = std::min(event_start, members[i].start);
+            event_stop = std::max(event_stop, members[i].stop);
+            if(members[i].high_confidence) {
+                num_high_confidence++;
+            }
+        }
+
+        // Consensus breakpoints are the (lower) median of the member breakpoints
+        std::nth_element(starts.begin(), starts.begin() + (starts.size() - 1) / 2, starts.end());
+        std::nth_element(stops.begin(), stops.begin() + (stops.size() - 1) / 2, stops.end());
+        long consensus_start = starts[(starts.size() - 1) / 2];
+        long consensus_stop = stops[(stops.size() - 1) / 2];
+
+        ofs << (e + 1) << ',' << members[0].ref << ",deletion,";
+        ofs << (event_start + 1) << ',' << (event_stop + 1) << ',';
+        ofs << (consensus_start + 1) << ',' << (consensus_stop + 1) << ',';
+        ofs << samples.size() << ',' << num_high_confidence << ',';
+        for(auto it = samples.begin(); it != samples.end(); ++it) {
+            if(it != samples.begin()) {
+                ofs << ';';
+            }
+            ofs << *it;
+        }
+        ofs << std::endl;
+    }
+
+    long bytes_written = ofs.tellp();
+    ofs.close();
+    return bytes_written;
+}
@@ -2,6 +2,8 @@
 #define SIMPLE_SNP_LARGE_INDEL_FINDER_H
 
 #include "args.h"
+#include "paged_array.h"
+#include "concurrent_buffer_queue.h"
 #include <vector>
 #include <unordered_map>
 #include <string>
@@ -13,6 +15,7 @@
 struct GenomicRange {
     GenomicRange(int this_id,
                  int this_parent_id,
+                 std::string this_sample,
                  std::string this_ref,
                  long this_start,
                  long this_stop,
@@ -20,6 +23,7 @@ struct GenomicRange {
                  bool this_confidence)
                  : id(this_id),
                  parent_id(this_parent_id),
+                 sample(this_sample),
                  ref(this_ref),
                  start(this_start),
                  stop(this_stop),
@@ -35,6 +39,7 @@ struct GenomicRange {
 
     int id;
     int parent_id;
+    std::string sample;
     std::string ref;
     long start;
     long stop;
@@ -47,17 +52,27 @@ class LargeIndelFinder {
 public:
     LargeIndelFinder(Args &args);
 
-    void findLargeIndels(const std::unordered_map< std::string,
-                         std::unordered_map< std::string,
-                         std::vector< std::vector< int > > > > &nucleotide_counts);
+    // Every sample and reference pushed to buffer_q, in id order; in out-of-core mode read back from the spills.
+    // Parsing must have completed.
+    void findLargeIndels(ConcurrentBufferQueue* buffer_q);
 
 private:
+    // nucl holds the 4 allele count rows, or a single row of total depth; only the per-position sum is used
+    void _findSampleRanges(const std::string &sample,
+                           const std::string &this_ref,
+                           const std::vector< PagedArray< int > > &nucl,
+                           std::ofstream &this_ofs,
+                           std::vector< GenomicRange > &all_ranges);
     void _determineRanges(const std::string &out_prefix,
-                          const std::vector< std::vector< int > > &nucl,
+                          const std::vector< PagedArray< int > > &nucl,
                           std::ofstream &this_ofs,
                           std::vector< std::pair< long, long > > &ranges,
                           std::vector< double > &coverages,
                           std::vector< bool > &high_confidence);
+    void _clusterRanges(std::vector< GenomicRange > &all_ranges,
+                        std::vector< std::vector< GenomicRange > > &events);
+    // Returns the bytes written
+    long _writeEvents(const std::vector< std::vector< GenomicRange > > &events);
 
     Args& _args;
     std::unordered_map< std::string, std::pair< long, std::vector< std::string > > > _large_indels;
@@ -1,110 +1,42 @@
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <unordered_map>
 #include <map>
-#include <queue>
+#include <set>
 #include <utility>
-#include <cmath>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <filesystem>
+#include <chrono>
+#include <sys/resource.h>
 #include "args.h"
 #include "dispatch_queue.h"
 #include "concurrent_buffer_queue.h"
 #include "file_finder.h"
 #include "fasta_parser.h"
-#include "vcf_writer.h"
 #include "large_indel_finder.h"
+#include "variant_caller.h"
+#include "cohort_store.h"
+#include "sam_header.h"
+#include "input_prefetcher.h"
+#include "task_trace.h"
 
 
 int main(int argc, const char *argv[]) {
+    std::chrono::steady_clock::time_point run_start = std::chrono::steady_clock::now();
     Args args(argc, argv);
-
-    // Optionally load database annotations
-    if(args.db_ann_file != "") {
-        std::ifstream ifs6(args.db_ann_file, std::ios::in);
-        std::string ann_line, ann_acc, ann_entry;
-        std::stringstream ann_ss;
-        std::getline(ifs6, ann_line);  // Skip header
-        while(std::getline(ifs6, ann_line)) {
-            if(ann_line.empty()) {
-                continue;
-            }
-            ann_ss.clear();
-            ann_ss.str(ann_line);
-            std::getline(ann_ss, ann_acc, ',');
-            if(!args.db_ann_map.count(ann_acc)) {
-                args.db_ann_map[ann_acc] = std::vector< std::vector< std::string > >(1, std::vector< std::string >());
-            }
-            else {
-                args.db_ann_map.at(ann_acc).push_back(std::vector< std::string >());
-            }
-            int j_vec_idx = args.db_ann_map.at(ann_acc).size() - 1;
-            for(int i = 0; i < 5; ++i) {
-                std::getline(ann_ss, ann_entry, ',');
-                args.db_ann_map.at(ann_acc)[j_vec_idx].push_back(ann_entry);
-            }
-        }
-        ifs6.close();
+    if(!args.trace_path.empty()) {
+        TaskTrace::enable();
+        TaskTrace::setThreadName("Main");
     }
 
-    // Optionally load database names
-    if(!args.db_names_file.empty()) {
-        std::ifstream ifs7(args.db_names_file, std::ios::in);
-        std::string names_line, names_parent, names_child, names_alias;
-        std::stringstream names_ss;
-        while(std::getline(ifs7, names_line)) {
-            if(names_line.empty()) {
-                continue;
-            }
-            names_ss.clear();
-            names_ss.str(names_line);
-            std::getline(names_ss, names_parent, ',');
-            std::getline(names_ss, names_alias, ',');
-            std::size_t div_pos = names_parent.find(':');
-            if(div_pos == std::string::npos) {
-                // No children are present
-                if(args.db_parent_name_map.count(names_parent)) {
-                    std::cerr << "ERROR: Parent chromosomes must be unique if no children are present,";
-                    std::cerr << " (duplicate detected): ";
-                    std::cerr << names_parent << std::endl;
-                    exit(EXIT_FAILURE);
-                }
-                args.db_parent_name_map[names_parent] = names_alias;
-                args.db_child_name_map[names_parent] = names_alias;
-                args.db_parent_map[names_parent] = std::vector< std::string > {names_parent};
-                args.rev_db_parent_map[names_parent] = names_parent;
-            }
-            else {
-                // Children are present
-                // names_alias format: parent_name\tchild_name
-                names_child = names_parent.substr(div_pos + 1);
-                names_parent.erase(div_pos);
-                if(args.db_parent_map.count(names_parent)) {
-                    args.db_parent_map.at(names_parent).push_back(names_child);
-                }
-                else {
-                    args.db_parent_map[names_parent] = std::vector< std::string > {names_child};
-                    if(args.rev_db_parent_map.count(names_child)) {
-                        std::cerr << "ERROR: Child chromosomes must be unique (duplicate detected): ";
-                        std::cerr << names_parent << " -> " << names_child << std::endl;
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                args.rev_db_parent_map[names_child] = names_parent;
-                if(args.db_child_name_map.count(names_child)) {
-                    std::cerr << "ERROR: Child chromosomes must be unique (duplicate detected): ";
-                    std::cerr << names_parent << " -> " << names_child << ": " << names_alias << std::endl;
-                    exit(EXIT_FAILURE);
-                }
-                if(!args.db_parent_name_map.count(names_parent)) {
-                    std::size_t parent_found = names_alias.find_last_of(',');
-                    args.db_parent_name_map[names_parent] = names_alias.substr(0, parent_found - 1);
-                }
-                std::size_t child_found = names_alias.find_last_of(',');
-                args.db_child_name_map[names_child] = names_alias.substr(child_found + 1);
-            }
-        }
-        ifs7.close();
+    // Optionally load database annotations and names from the compiled index, rebuilding it if the text files changed
+    if(!args.db_ann_file.empty()) {
+        args.db_index.load(args.db_ann_file, args.db_names_file, args.db_index_file);
     }
 
     // Load SAM file paths
@@ -113,80 +45,131 @@ int main(int argc, const char *argv[]) {
 
     DispatchQueue* output_buffer_dispatcher = new DispatchQueue(1, false);
     DispatchQueue* job_dispatcher = new DispatchQueue(args.threads - 1, true);
+
+    // Pre-flight: a bad or inconsistent header in any SAM file fails the run before the first pileup is allocated
+    std::vector< SamHeader > headers = SamHeader::preflight(sam_files, args, job_dispatcher);
+
     ConcurrentBufferQueue* concurrent_q = new ConcurrentBufferQueue();
+    concurrent_q->spill_dir = args.spill_dir;
+    if(!args.spill_dir.empty()) {
+        // Out-of-core calling keeps every sample's spill file open, so allow as many descriptors as the system does
+        struct rlimit fd_limit;
+        if(getrlimit(RLIMIT_NOFILE, &fd_limit) == 0) {
+            fd_limit.rlim_cur = fd_limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &fd_limit);
+        }
+    }
     output_buffer_dispatcher->dispatch([concurrent_q] () {concurrent_q->run();});
 
+    FastaParser fasta_parser(args.reference_path);
+
+    // Incremental mode: SAM files already ingested into the cohort store are not reparsed
+    std::unique_ptr< CohortStore > cohort_store;
+    if(!args.cohort_store_dir.empty()) {
+        cohort_store = std::make_unique< CohortStore >(args.cohort_store_dir);
+        cohort_store->loadManifest();
+    }
+
+    // { pileup path : SAM cache key } for SAM files parsed in this run
+    std::map< std::string, std::string > new_pileups;
+    // Store pileup paths of every SAM file in this run, parsed or not
+    std::set< std::string > store_pileups;
+    // Indices into sam_files of the SAM files to parse in this run, in dispatch order, with their ParserJob
+    // parameter strings
+    std::vector< int > parse_idxs;
+    std::vector< std::string > parse_params;
     for(int i = 0; i < sam_files.size(); ++i) {
         std::string this_sam_fp = sam_files[i];
         std::size_t pos1 = this_sam_fp.find_last_of('/');
         std::string this_filename = this_sam_fp.substr(pos1 + 1);
         std::size_t pos2 = this_filename.find_first_of('.');
         std::string this_samplename = this_filename.substr(0, pos2);
+        if(this_sam_fp == "-") {
+            this_samplename = "stdin";
+        }
         std::string this_param_string = this_sam_fp + '|' + this_samplename;
 
-        std::unique_ptr< ParserJob > job = std::make_unique< ParserJob > (this_param_string, args.output_dir, concurrent_q, args);
-        job_dispatcher->dispatch(std::move(job));
-        concurrent_q->num_active_jobs += 1;
-    }
-    concurrent_q->all_jobs_enqueued = true;
-
-    while(concurrent_q->num_completed_jobs != sam_files.size()) {}
-    concurrent_q->all_jobs_consumed = true;
-
-    while(!concurrent_q->work_completed) {}
-
-//    std::cout << "Single threaded section start" << std::endl;
-
-    // Section for large indel determination
-    LargeIndelFinder indel_finder(args);
-    indel_finder.findLargeIndels(concurrent_q->all_nucleotide_counts);
-
-    // Each worker thread has written a file with positional counts and info for each sample.  This section is for
-    // variant calling across all samples using the thresholds/options specified in args.
-
-    // Check to ensure all SAM files have a valid reference (parent/child relationship for multi-chromosome refs)
-    // Store ordered vectors of samples/refs
-    std::vector< std::string > ordered_sample_names;
-    std::string this_parent_ref = "";
-    std::string sample_ref;
-    for(auto &[sample, ref_map] : concurrent_q->all_nucleotide_counts) {
-        for(auto &[ref, nucl] : ref_map) {
-            if(!args.db_names_file.empty()) {
-                sample_ref = args.rev_db_parent_map.at(ref);
-            }
-            else {
-                sample_ref = ref;
-            }
-            if(this_parent_ref.empty()) {
-                this_parent_ref = sample_ref;
+        // Stdin and named pipes are never cached, so they are parsed on every run
+        if(cohort_store && !SamReader::isStream(this_sam_fp)) {
+            std::string pileup_path = ParserJob::pileupCachePath(args, this_sam_fp, this_samplename);
+            std::string pileup_key = ParserJob::pileupCacheKey(this_sam_fp, args);
+            if(!store_pileups.insert(pileup_path).second) {
+                std::cerr << "ERROR: Cohort store entries are keyed by sample name, and two SAM files share the name ";
+                std::cerr << this_samplename << ": " << this_sam_fp << std::endl;
+                std::exit(EXIT_FAILURE);
             }
-            else {
-                if(this_parent_ref != sample_ref) {
-                    std::cerr << "ERROR: All SAM files must be aligned to the same reference. If the reference used ";
-                    std::cerr << "has multiple chromosomes/segments, they must be defined in <reference_db>.names ";
-                    std::cerr << "(see documentation). Clashing references: " << this_parent_ref << ", " << sample_ref;
-                    std::cerr << std::endl;
-                    std::exit(EXIT_FAILURE);
-                }
+            if(cohort_store->contains(pileup_path, pileup_key)) {
+                continue;
             }
+            new_pileups[pileup_path] = pileup_key;
         }
-        ordered_sample_names.push_back(sample);
+        parse_idxs.push_back(i);
+        parse_params.push_back(this_param_string);
     }
-    std::sort(ordered_sample_names.begin(), ordered_sample_names.end());
 
-    std::vector< std::string > ordered_refs;
+    // Stored samples that are not reparsed are loaded as they are, so a different reference or -q/-Q/-m would
+    // silently mix pileups built two ways
+    if(cohort_store) {
+        std::string options_key = ParserJob::pileupOptionsKey(args);
+        for(auto &[pileup_path, pileup_key] : cohort_store->entries) {
+            if(!new_pileups.count(pileup_path) && !cohort_store->builtWith(pileup_path, options_key)) {
+                std::cerr << "ERROR: Cohort store sample was built with a different reference or -q/-Q/-m than this ";
+                std::cerr << "run: " << pileup_path << std::endl;
+                std::cerr << "Rerun with the store's options, or pass the sample's SAM file to reparse it" << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        // A reparsed sample's old pileup file is dropped first, so after the run a store file exists only if this
+        // run saved it (no reads, a bad header or a failed save leave none)
+        for(auto &[pileup_path, pileup_key] : new_pileups) {
+            cohort_store->remove(pileup_path);
+        }
+    }
 
-    if(!args.db_names_file.empty()) {
-        for(int i = 0; i < args.db_parent_map.at(this_parent_ref).size(); ++i) {
-            ordered_refs.push_back(args.db_parent_map.at(this_parent_ref)[i]);
+    // Calling overlaps parsing when the pre-flight headers give every sample's parent reference group up front:
+    // each group's caller is queued behind the parse jobs and calls each reference as soon as the last file covering
+    // it is parsed.  Stdin/named pipes (header not pre-read) and stored samples (no SAM header) are only known once
+    // loaded, so those runs group samples and start calling after all input is in.
+    bool overlap_calling = !cohort_store;
+    for(const int &i : parse_idxs) {
+        overlap_calling = overlap_calling && !SamReader::isStream(sam_files[i]);
+    }
+    std::map< std::string, std::vector< std::string > > parent_samples;
+    if(overlap_calling) {
+        std::map< std::string, std::set< std::string > > group_samples;
+        for(const int &i : parse_idxs) {
+            const SamHeader &header = headers[i];
+            if(!header.has_alignments) {
+                continue;
+            }
+            concurrent_q->expectParse(header.sam_filepath, header.parent_ref, header.refs, header.readgroup_samples);
+            group_samples[header.parent_ref].insert(header.readgroup_samples.begin(), header.readgroup_samples.end());
+        }
+        for(auto &[parent_ref, samples] : group_samples) {
+            parent_samples[parent_ref].assign(samples.begin(), samples.end());
         }
     }
-    else {
-        ordered_refs.push_back(this_parent_ref);
+
+    // Many small SAM files: one thread keeps the next files read ahead of the parsers (two per parser thread)
+    std::unique_ptr< InputPrefetcher > input_prefetcher;
+    if(args.prefetch_input) {
+        std::vector< std::string > prefetch_files;
+        for(const int &i : parse_idxs) {
+            if(!SamReader::isStream(sam_files[i])) {
+                prefetch_files.push_back(sam_files[i]);
+            }
+        }
+        input_prefetcher = std::make_unique< InputPrefetcher >(prefetch_files, 2 * args.threads, 1L << 24, true);
+        concurrent_q->input_prefetcher = input_prefetcher.get();
     }
 
-    std::ofstream ofs(args.output_dir + "/all_sample_variants.tsv");
-    std::ofstream ofs2(args.output_dir + "/dominant_population_variants.tsv");
+    int num_dispatched_jobs = 0;
+    for(const std::string &this_param_string : parse_params) {
+        std::unique_ptr< ParserJob > job = std::make_unique< ParserJob > (this_param_string, args.output_dir, concurrent_q, args);
+        job_dispatcher->dispatch(std::move(job));
+        concurrent_q->num_active_jobs += 1;
+        num_dispatched_jobs++;
+    }
 
     // VCF Writer
     std::string command_string = "simple_snp " + args.sam_file_dir + " " + args.output_dir + " " + args.reference_path;
@@ -194,685 +177,245 @@ int main(int argc, const char *argv[]) {
     command_string += " -A " + std::to_string(args.min_inter_sample_alt) + " -d " + std::to_string(args.min_intra_sample_depth);
     command_string += " -D " + std::to_string(args.min_inter_sample_depth) + " -f " + std::to_string(args.min_minor_freq);
     command_string += " -F " + std::to_string(args.min_major_freq);
-    if(!args.db_ann_file.empty()) {
-        command_string += " -n " + args.db_ann_file;
+    if(args.max_depth > 0) {
+        command_string += " -m " + std::to_string(args.max_depth);
     }
-
-    // Load FASTA reference genome
-    FastaParser fasta_parser(args.reference_path);
-    fasta_parser.parseFasta(ordered_refs);
-
-    std::vector< long > contig_lens;
-    for(int i = 0; i < ordered_refs.size(); ++i) {
-        contig_lens.push_back(fasta_parser.headers_lens.at(ordered_refs[i]));
+    if(args.min_mapq > 0) {
+        command_string += " -q " + std::to_string(args.min_mapq);
     }
-
-    std::string vcf_path = args.output_dir + "/dominant_population_variants.vcf";
-    VcfWriter vcf_writer(vcf_path);
-    vcf_writer.open();
-    vcf_writer.writeHeaders(args.reference_path,
-                            command_string,
-                            ordered_refs,
-                            contig_lens);
-    vcf_writer.writeSamples(ordered_sample_names);
-
-    ofs << "Position";
-    ofs2 << "Position";
-    for(int i = 0; i < ordered_sample_names.size(); ++i) {
-        ofs << '\t' << ordered_sample_names[i];
-        ofs2 << '\t' << ordered_sample_names[i];
+    if(args.min_base_qual > 0) {
+        command_string += " -Q " + std::to_string(args.min_base_qual);
+    }
+    if(!args.db_ann_file.empty()) {
+        command_string += " -n " + args.db_ann_file;
     }
-    ofs << std::endl;
-    ofs2 << std::endl;
-
-    std::string this_nucleotides = "ACGT";
-    for(int r = 0; r < ordered_refs.size(); ++r) {
-        std::string this_ref = ordered_refs[r];
-        std::string this_seq = fasta_parser.headers_seqs.at(this_ref);
-        for(long j = 0; j < this_seq.length(); ++j) {
-            long population_depth = 0;
-            // <A, C, G, T>
-            std::vector< long > population_allele_counts(4, 0);
-            std::unordered_map< int, long > population_insertions;
-            std::unordered_map< int, long > population_deletions;
-
-            // First pass to look at population metrics
-            for(auto &[sample, ref_map] : concurrent_q->all_nucleotide_counts) {
-//                std::cout << (j+1) << '\t' << sample << std::endl;
-                std::vector< std::vector< int > > *nucl = &ref_map.at(this_ref);
-                std::unordered_map< long, std::unordered_map< int, std::vector< long > > > *ins = &concurrent_q->all_insertions.at(sample).at(this_ref);
-                std::unordered_map< long, std::unordered_map< int, std::vector< long > > > *del = &concurrent_q->all_deletions.at(sample).at(this_ref);
-                long sample_depth = 0;
-                for(int i = 0; i < population_allele_counts.size(); ++i) {
-                    population_depth += (*nucl)[i][j];
-                    sample_depth += (*nucl)[i][j];
-                }
-
-//                std::cout << "\tcheck1" << std::endl;
-
-                if((*ins).count(j)) {
-                    for(auto &[len, ins_vec] : (*ins).at(j)) {
-                        population_depth += ins_vec[0];
-                        sample_depth += ins_vec[0];
-                    }
-                }
-
-                if((*del).count(j)) {
-                    for(auto &[len, del_vec] : (*del).at(j)) {
-                        population_depth += del_vec[0];
-                        sample_depth += del_vec[0];
-                    }
-                }
-
-                if(population_depth < args.min_inter_sample_depth) {
-                    continue;
-                }
-
-                for(int i = 0; i < population_allele_counts.size(); ++i) {
-                    double this_allele_freq = (double)(*nucl)[i][j] / (double)sample_depth;
-                    if(this_allele_freq >= args.min_major_freq) {
-                        if(this_nucleotides.at(i) != this_seq.at(j)) {
-                            population_allele_counts[i] += (*nucl)[i][j];
-                        }
-                    }
-                }
-
-//                std::cout << "\tcheck2" << std::endl;
-
-                // indel frequency is calculated across all indel lengths to identify candidate indels at a given
-                // position. This is to mitigate the effect of nanopore sequencing noise, particular when indels
-                // are identified near homopolymer runs.
-                if((*ins).count(j)) {
-                    double this_ins_freq = 0;
-                    for(auto &[len, ins_vec] : (*ins).at(j)) {
-                         this_ins_freq += (double)ins_vec[0];
-                    }
-                    this_ins_freq /= (double)sample_depth;
-                    if(this_ins_freq >= args.min_major_freq) {
-                        for(auto &[len, ins_vec] : (*ins).at(j)) {
-                            if(!population_insertions.count(len)) {
-                                population_insertions[len] = ins_vec[0];
-                            }
-                            else {
-                                population_insertions.at(len) += ins_vec[0];
-                            }
-                        }
-                    }
-                }
-
-                if((*del).count(j)) {
-                    double this_del_freq = 0;
-                    for(auto &[len, del_vec] : (*del).at(j)) {
-                        this_del_freq += (double)del_vec[0];
-                    }
-                    this_del_freq /= (double)sample_depth;
-                    if(this_del_freq >= args.min_major_freq) {
-                        for(auto &[len, del_vec] : (*del).at(j)) {
-                            if(!population_deletions.count(len)) {
-                                population_deletions[len] = del_vec[0];
-                            }
-                            else {
-                                population_deletions[len] += del_vec[0];
-                            }
-                        }
-                    }
-                }
-            }
 
-            bool meets_population_threshold = false;
-            for(int i = 0; i < population_allele_counts.size(); ++i) {
-                meets_population_threshold |= (population_allele_counts[i] > args.min_inter_sample_alt);
+    // Each worker thread has written a file with positional counts and info for each sample.  This section is for
+    // variant calling across all samples using the thresholds/options specified in args.  Parent reference groups
+    // are called concurrently on the parser thread pool, each writing its own output files; the file names are
+    // prefixed with the parent reference only when more than one group is present.  A caller is dispatched once the
+    // first reference of its group is ready, so callers still waiting on parse jobs never hold up ready ones, and
+    // waits for the FASTA contigs to be selected, which happens in the background once the groups are known.
+    std::vector< std::unique_ptr< VariantCaller > > callers;
+    std::vector< int > caller_parent_refs;
+    std::vector< int > caller_first_refs;
+    int num_dispatched_callers = 0;
+    std::atomic< int > num_completed_callers = ATOMIC_VAR_INIT(0);
+    std::atomic< bool > fasta_loaded = ATOMIC_VAR_INIT(false);
+    std::vector< std::string > all_refs;
+    auto create_callers = [&] () {
+        std::map< std::string, std::vector< std::string > > parent_refs;
+        for(auto &[parent_ref, samples] : parent_samples) {
+            if(!args.db_names_file.empty()) {
+                parent_refs[parent_ref] = args.db_index.childrenOf(parent_ref);
             }
-
-//            std::cout << "\tcheck3" << std::endl;
-
-            long population_ins_sums = 0;
-            for(auto &[len, val] : population_insertions) {
-                population_ins_sums += val;
+            else {
+                parent_refs[parent_ref] = std::vector< std::string > {parent_ref};
             }
-//            meets_population_threshold |= (population_ins_sums > args.min_inter_sample_alt);
+            all_refs.insert(all_refs.end(), parent_refs.at(parent_ref).begin(), parent_refs.at(parent_ref).end());
+        }
 
-            long population_del_sums = 0;
-            for(auto &[len, val] : population_deletions) {
-                population_del_sums += val;
+        for(auto &[parent_ref, samples] : parent_samples) {
+            std::string output_prefix = "";
+            if(parent_samples.size() > 1) {
+                output_prefix = parent_ref + "_";
             }
-//            meets_population_threshold |= (population_del_sums > args.min_inter_sample_alt);
-
-            if(!meets_population_threshold) {
+            callers.push_back(std::make_unique< VariantCaller >(args,
+                                                                concurrent_q,
+                                                                &fasta_parser,
+                                                                parent_ref,
+                                                                samples,
+                                                                parent_refs.at(parent_ref),
+                                                                output_prefix,
+                                                                command_string));
+            caller_parent_refs.push_back(concurrent_q->ref_names.intern(parent_ref));
+            caller_first_refs.push_back(concurrent_q->ref_names.intern(parent_refs.at(parent_ref).front()));
+        }
+    };
+    // Callers are dispatched in the order their groups become ready
+    std::vector< bool > caller_dispatched;
+    auto dispatch_ready_callers = [&] () {
+        caller_dispatched.resize(callers.size(), false);
+        for(int c = 0; c < callers.size(); ++c) {
+            if(caller_dispatched[c] || !concurrent_q->refReady(caller_parent_refs[c], caller_first_refs[c])) {
                 continue;
             }
+            VariantCaller* caller = callers[c].get();
+            job_dispatcher->dispatch([caller, &fasta_loaded, &num_completed_callers] () {
+                while(!fasta_loaded) {
+                    std::this_thread::yield();
+                }
+                caller->run();
+                num_completed_callers += 1;
+            });
+            caller_dispatched[c] = true;
+            num_dispatched_callers++;
+        }
+    };
 
-            // Second pass to establish variants present and their codes
-            vcfLineData vcf_line_data;
-            vcf_line_data.dp = 0;
-
-            bool position_has_variant = false;
-            bool position_has_major_variant = false;
-            std::string alts_present_at_pos = "";
-            for(auto &[sample, ref_map] : concurrent_q->all_nucleotide_counts) {
-                std::vector< std::vector< int > > *nucl = &ref_map.at(this_ref);
-                std::unordered_map< long, std::unordered_map< int, std::vector< long > > > *ins = &concurrent_q->all_insertions.at(sample).at(this_ref);
-                std::unordered_map< long, std::unordered_map< int, std::vector< long > > > *del = &concurrent_q->all_deletions.at(sample).at(this_ref);
-                long sample_depth = 0;
-                for(int i = 0; i < population_allele_counts.size(); ++i) {
-                    sample_depth += (*nucl)[i][j];
-                }
-
-
-                if((*ins).count(j)) {
-                    for(auto &[len, ins_vec] : (*ins).at(j)) {
-                        sample_depth += ins_vec[0];
-                    }
-                }
-
-                if((*del).count(j)) {
-                    for(auto &[len, del_vec] : (*del).at(j)) {
-                        sample_depth += del_vec[0];
-                    }
-                }
-
-                vcf_line_data.dp += sample_depth;
-
-                for(int i = 0; i < population_allele_counts.size(); ++i) {
-                    double this_allele_freq = (double)(*nucl)[i][j] / (double)sample_depth;
-                    if((this_allele_freq >= args.min_minor_freq) && ((*nucl)[i][j] >= args.min_intra_sample_alt) && (sample_depth > args.min_intra_sample_depth)) {
-                        if(this_nucleotides.at(i) != this_seq.at(j)) {
-                            if(alts_present_at_pos.find(this_nucleotides.at(i)) == std::string::npos) {
-                                alts_present_at_pos += this_nucleotides.at(i);
-                            }
-                            position_has_variant = true;
-                            if(this_allele_freq >= args.min_major_freq) {
-                                position_has_major_variant = true;
-                            }
-                        }
-                    }
-                }
-
-                if((*ins).count(j)) {
-                    double this_ins_freq = 0;
-                    long this_ins_count = 0;
-                    for(auto &[len, ins_vec] : (*ins).at(j)) {
-                        this_ins_count += ins_vec[0];
-                        this_ins_freq += (double)ins_vec[0];
-                    }
-                    this_ins_freq /= (double)sample_depth;
-                    if((this_ins_freq >= args.min_minor_freq) && (this_ins_count >= args.min_intra_sample_alt) && (sample_depth > args.min_intra_sample_depth)) {
-//                        std::cout << sample << '\t' << this_ref << ':' << std::to_string(j+1) << "\tInsertion\t" << this_ins_count;
-//                        std::cout << '\t' << this_ins_freq << std::endl;
-//                        for(auto &[len, ins_vec] : (*ins).at(j)) {
-//                            std::cout << '\t' << len << '\t' << ins_vec[0] << '\t' << ins_vec[1] << '\t';
-//                            std::cout << ins_vec[2] << '\t' << ins_vec[3] << std::endl;
-//                        }
-                        if(alts_present_at_pos.find('I') == std::string::npos) {
-//                            alts_present_at_pos += 'I';
-                        }
-//                        position_has_variant = true;
-                        if(this_ins_freq >= args.min_major_freq) {
-//                            position_has_major_variant = true;
-                        }
-                    }
-                }
-
-                if((*del).count(j)) {
-                    double this_del_freq = 0;
-                    long this_del_count = 0;
-                    for(auto &[len, del_vec] : (*del).at(j)) {
-                        this_del_count += del_vec[0];
-                        this_del_freq += (double)del_vec[0];
-                    }
-                    this_del_freq /= (double)sample_depth;
-                    if((this_del_freq >= args.min_minor_freq) && (this_del_count >= args.min_intra_sample_alt) && (sample_depth > args.min_intra_sample_depth)) {
-                        if(alts_present_at_pos.find('D') == std::string::npos) {
-//                            alts_present_at_pos += 'D';
-                        }
-//                        position_has_variant = true;
-                        if(this_del_freq >= args.min_major_freq) {
-//                            position_has_major_variant = true;
-//                            std::cout << sample << '\t' << this_ref << ':' << std::to_string(j+1) << "\tDeletion\t" << this_del_count;
-//                            std::cout << '\t' << this_del_freq << std::endl;
-//                            for(auto &[len, del_vec] : (*del).at(j)) {
-//                                std::cout << '\t' << len << '\t' << del_vec[0] << '\t' << del_vec[1] << '\t';
-//                                std::cout << del_vec[2] << std::endl;
-//                            }
-                        }
-                    }
-                }
-            }
-
-//            std::cout << "\tcheck4" << std::endl;
-
-            if(!position_has_variant) {
+    // Map and index the FASTA reference, and select the called contigs from it, while the SAM files are parsed;
+    // sequences are loaded when calling reaches them
+    if(overlap_calling) {
+        create_callers();
+        dispatch_ready_callers();
+    }
+    std::thread fasta_index_thread([&fasta_parser, &all_refs, &fasta_loaded, overlap_calling, concurrent_q] () {
+        TaskTrace::setThreadName("FASTA index");
+        StageTimer timer(concurrent_q->metrics, RunMetrics::fasta_load);
+        fasta_parser.indexFasta();
+        if(overlap_calling) {
+            fasta_parser.parseFasta(all_refs);
+            fasta_loaded = true;
+        }
+    });
+
+    // Every other stored sample is loaded from its pileup file while the new SAM files are parsed
+    std::atomic< int > num_completed_loads = ATOMIC_VAR_INIT(0);
+    int num_dispatched_loads = 0;
+    if(cohort_store) {
+        CohortStore* store = cohort_store.get();
+        for(auto &[pileup_path, pileup_key] : cohort_store->entries) {
+            if(new_pileups.count(pileup_path)) {
                 continue;
             }
+            std::string this_pileup_path = pileup_path;
+            job_dispatcher->dispatch([store, this_pileup_path, concurrent_q, &num_completed_loads] () {
+                TraceScope trace("CohortStore load", this_pileup_path);
+                store->loadSample(this_pileup_path, concurrent_q);
+                num_completed_loads += 1;
+            });
+            num_dispatched_loads++;
+        }
+    }
+    concurrent_q->all_jobs_enqueued = true;
 
-            vcf_line_data.chrom = this_ref;
-            vcf_line_data.ref = this_seq.at(j);
-            vcf_line_data.pos = j+1;
-            vcf_line_data.qual = 0;
-            vcf_line_data.ns = 0;
-            vcf_line_data.ro = 0;
-            vcf_line_data.mqmr = 0;
-            vcf_line_data.ao_sum = 0;
-            vcf_line_data.nsa = 0;
-            for(int i = 0; i < alts_present_at_pos.size(); ++i) {
-
-                if(alts_present_at_pos.at(i) == 'I') {
-                    vcf_line_data.type.push_back("ins");
-                }
-                else if(alts_present_at_pos.at(i) == 'D') {
-                    vcf_line_data.type.push_back("del");
-                }
-                else {
-                    vcf_line_data.type.push_back("snp");
-                }
-
-                // TODO:  needs to be moved below with incorporation of indels
-                vcf_line_data.cigar.push_back("1X");
-                vcf_line_data.af.push_back(0);
-                vcf_line_data.alt.push_back("");
-                vcf_line_data.alt[i] += alts_present_at_pos.at(i);
-                vcf_line_data.ao.push_back(0);
-                vcf_line_data.mqm.push_back(0);
-                vcf_line_data.alt_ns.push_back(0);
-                vcf_line_data.ac.push_back(0);
+    int num_seen_completions = 0;
+    while(concurrent_q->num_completed_jobs != num_dispatched_jobs) {
+        if(overlap_calling && (concurrent_q->num_ingested_parses != num_seen_completions)) {
+            num_seen_completions = concurrent_q->num_ingested_parses;
+            dispatch_ready_callers();
+        }
+    }
+    while(num_completed_loads != num_dispatched_loads) {}
+    concurrent_q->all_jobs_consumed = true;
+    concurrent_q->input_prefetcher = nullptr;
+    input_prefetcher.reset();
+
+    if(cohort_store) {
+        // SAM files that produced no saved pileup (e.g. no reads) are left out of the store
+        for(auto &[pileup_path, pileup_key] : new_pileups) {
+            if(std::filesystem::exists(pileup_path)) {
+                cohort_store->add(pileup_path, pileup_key);
             }
+        }
+        cohort_store->writeManifest();
+    }
 
-//            std::cout << "\tcheck5" << std::endl;
-
-            // Third pass to assign variants
-            std::map< std::string, std::string > positional_variants;
-            std::map< std::string, std::string > vcf_variants;
-            for(auto &[sample, ref_map] : concurrent_q->all_nucleotide_counts) {
-//                std::cout << "\tcheck 5.1" << std::endl;
-                std::vector< std::vector< int > > *nucl = &ref_map.at(this_ref);
-                std::vector< std::vector< long > > *qual = &concurrent_q->all_qual_sums.at(sample).at(this_ref);
-                std::vector< std::vector< long > > *mapq = &concurrent_q->all_mapq_sums.at(sample).at(this_ref);
-                std::unordered_map< long, std::unordered_map< int, std::vector< long > > > *ins = &concurrent_q->all_insertions.at(sample).at(this_ref);
-                std::unordered_map< long, std::unordered_map< int, std::vector< long > > > *del = &concurrent_q->all_deletions.at(sample).at(this_ref);
-                long sample_depth = 0;
-                int ref_allele_count;
-                double ref_qual;
-                for(int i = 0; i < population_allele_counts.size(); ++i) {
-                    sample_depth += (*nucl)[i][j];
-                    if(this_nucleotides.at(i) == this_seq.at(j)) {
-                        ref_allele_count = (*nucl)[i][j];
-                        ref_qual = (double)(*qual)[i][j];
-                        vcf_line_data.mqmr += (double)(*mapq)[i][j];
-                    }
-                }
-
-//                std::cout << "\tcheck 5.2" << std::endl;
-
-                if((*ins).count(j)) {
-                    for(auto &[len, ins_vec] : (*ins).at(j)) {
-                        sample_depth += ins_vec[0];
-                    }
-                }
-
-                if((*del).count(j)) {
-                    for(auto &[len, del_vec] : (*del).at(j)) {
-                        sample_depth += del_vec[0];
-                    }
-                }
-
-                if(sample_depth < args.min_intra_sample_depth) {
-                    std::string low_depth_info = "./.:" + std::to_string(sample_depth) + ":.:.:.";
-                    positional_variants.insert({sample, low_depth_info});
-                    // GT:DP:AD:RO:QR:AO:QA
-                    std::string low_vcf_info = "./.:" + std::to_string(sample_depth) + ":.";
-                    for(int i = 0; i < alts_present_at_pos.size(); ++i) {
-                        low_vcf_info += ",.";
-                    }
-                    low_vcf_info += ":.:.";
-                    for(int i = 1; i < alts_present_at_pos.size(); ++i) {
-                        low_vcf_info += ",.";
-                    }
-                    low_vcf_info += ":.:.";
-                    for(int i = 1; i < alts_present_at_pos.size(); ++i) {
-                        low_vcf_info += ",.";
-                    }
-                    vcf_variants.insert({sample, low_vcf_info});
-                    continue;
-                }
+    while(!concurrent_q->work_completed) {}
 
-//                std::cout << "\tcheck 5.3" << std::endl;
-
-                std::priority_queue< std::pair< double, std::string > > q;
-                for(int i = 0; i < population_allele_counts.size(); ++i) {
-//                    std::cout << "\tcheck 5.3.1" << std::endl;
-                    double this_allele_freq = (double)(*nucl)[i][j] / (double)sample_depth;
-                    if((this_allele_freq >= args.min_minor_freq) && ((*nucl)[i][j] >= args.min_intra_sample_alt) && (sample_depth > args.min_intra_sample_depth)) {
-                        std::string var_info;
-                        if(this_nucleotides.at(i) == this_seq.at(j)) {
-                            // Reference allele
-                            var_info = "0,";
-                        }
-                        else {
-                            std::size_t found = alts_present_at_pos.find(this_nucleotides.at(i));
-                            if(found == std::string::npos) {
-                                std::cerr << "Nucleotide called as variant (" << this_nucleotides.at(i);
-                                std::cerr << ") but not in alts (" << alts_present_at_pos << "), position: ";
-                                std::cerr << (j+1) << ", sample: " << sample << std::endl;
-                                std::exit(EXIT_FAILURE);
-                            }
-//                            std::cout << "\t\tfound: " << found << "\talts: " << alts_present_at_pos << std::endl;
-                            var_info = std::to_string(found + 1);
-                            var_info += ",";
-                            vcf_line_data.mqm[found] += (double)(*mapq)[i][j];
-                            vcf_line_data.ao[found] += (*nucl)[i][j];
-                            vcf_line_data.ao_sum += (*nucl)[i][j];
-                            vcf_line_data.qual += (double)(*qual)[i][j];
-                        }
-//                        std::cout << "\tcheck 5.3.2" << std::endl;
-
-                        var_info += std::to_string((*nucl)[i][j]);
-                        var_info += ",";
-                        var_info += std::to_string((double)(*qual)[i][j] / (double)(*nucl)[i][j]);
-                        var_info += ",";
-                        var_info += std::to_string((double)(*mapq)[i][j] / (double)(*nucl)[i][j]);
-                        var_info += ",";
-                        var_info += std::to_string(ref_allele_count);
-                        var_info += ",";
-                        if(ref_allele_count > 0) {
-                            var_info += std::to_string(ref_qual / (double)ref_allele_count);
-                        }
-                        else {
-                            var_info += ".";
-                        }
-                        q.emplace(this_allele_freq, var_info);
-                        vcf_line_data.ro += ref_allele_count;
-                    }
-//                    std::cout << "\tcheck 5.3.3" << std::endl;
-                }
+    RunMetrics &metrics = concurrent_q->metrics;
+    if(metrics.num_input_pipelines > 0) {
+        // Summed over SAM files; the parser overlaps the reader, so a reader stall means parsing is the bottleneck
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "Input pipeline over " << metrics.num_input_pipelines << " SAM files (s): reader busy ";
+        std::cout << (metrics.input_read_ns / 1e9) << ", stalled on full ring ";
+        std::cout << (metrics.input_read_stall_ns / 1e9) << "; parser busy ";
+        std::cout << (metrics.input_parse_ns / 1e9) << ", stalled on empty ring ";
+        std::cout << (metrics.input_parse_stall_ns / 1e9) << std::endl;
+    }
 
-//                std::cout << "\tcheck6" << std::endl;
+    if(args.max_depth > 0) {
+        std::cout << "Reads skipped at positions above max depth (" << args.max_depth << "): ";
+        std::cout << metrics.num_depth_skipped_reads << std::endl;
+    }
 
-                if((*ins).count(j)) {
-                    double this_ins_freq = 0;
-                    long this_ins_count = 0;
-                    for(auto &[len, ins_vec] : (*ins).at(j)) {
-                        this_ins_count += ins_vec[0];
-                        this_ins_freq += (double)ins_vec[0];
-                    }
-                    this_ins_freq /= (double)sample_depth;
-                    if((this_ins_freq >= args.min_minor_freq) && (this_ins_count >= args.min_intra_sample_alt)) {
-//                        std::cout << this_ref << ':' << std::to_string(j+1) << "\tInsertion\t" << this_ins_count;
-//                        std::cout << '\t' << this_ins_freq << std::endl;
-//                        for(auto &[len, ins_vec] : (*ins).at(j)) {
-//                            std::cout << '\t' << len << '\t' << ins_vec[0] << '\t' << ins_vec[1] << '\t';
-//                            std::cout << ins_vec[2] << '\t' << ins_vec[3] << std::endl;
-//                        }
+    // Without pre-flight groups: check to ensure all SAM files have a valid reference (parent/child relationship for
+    // multi-chromosome refs) and partition the samples by the parent reference they were aligned to.  Each group is
+    // called separately.
+    if(!overlap_calling) {
+        std::unordered_map< std::string, std::vector< std::string > > sample_refs;
+        if(args.spill_dir.empty()) {
+            for(int s = 0; s < concurrent_q->all_pileups.size(); ++s) {
+                for(int r = 0; r < concurrent_q->all_pileups[s].size(); ++r) {
+                    if(concurrent_q->all_pileups[s][r]) {
+                        sample_refs[concurrent_q->sample_names.name(s)].push_back(concurrent_q->ref_names.name(r));
                     }
                 }
-
-                if((*del).count(j)) {
-                    double this_del_freq = 0;
-                    long this_del_count = 0;
-                    for(auto &[len, del_vec] : (*del).at(j)) {
-                        this_del_count += del_vec[0];
-                        this_del_freq += (double)del_vec[0];
-                    }
-                    this_del_freq /= (double)sample_depth;
-                    if((this_del_freq >= args.min_minor_freq) && (this_del_count >= args.min_intra_sample_alt)) {
-//                        std::cout << this_ref << ':' << std::to_string(j+1) << "\tDeletion\t" << this_del_count;
-//                        std::cout << '\t' << this_del_freq << std::endl;
-//                        for(auto &[len, del_vec] : (*del).at(j)) {
-//                            std::cout << '\t' << len << '\t' << del_vec[0] << '\t' << del_vec[1] << '\t';
-//                            std::cout << del_vec[2] << std::endl;
-//                        }
+            }
+        }
+        else {
+            for(int s = 0; s < concurrent_q->all_spills.size(); ++s) {
+                for(int r = 0; r < concurrent_q->all_spills[s].size(); ++r) {
+                    if(!concurrent_q->all_spills[s][r].empty()) {
+                        sample_refs[concurrent_q->sample_names.name(s)].push_back(concurrent_q->ref_names.name(r));
                     }
                 }
+            }
+        }
 
-                if(q.size() > 2) {
-                    std::cerr << "Tri-allelic site detected at sample:position, " << sample << " ";
-                    std::cerr << this_ref << ":" << (j+1) << std::endl;
-                    while(!q.empty()) {
-                        std::pair< double, std::string > temp_var_info = q.top();
-                        std::cerr << temp_var_info.first << '\t' << temp_var_info.second << std::endl;
-                        q.pop();
-                    }
-//                    std::cout << std::endl;
-                    std::exit(EXIT_FAILURE);
+        std::string sample_ref;
+        for(auto &[sample, refs] : sample_refs) {
+            std::string this_parent_ref = "";
+            for(const std::string &ref : refs) {
+                if(!args.db_names_file.empty()) {
+                    sample_ref = args.db_index.parentOf(ref);
                 }
-
-//                std::cout << "\tcheck7" << std::endl;
-
-                std::string final_var_info = "";
-                std::string final_vcf_info = "";
-                if(q.size() == 2) {
-//                    std::cout << "\tcheck2 qsize 2" << std::endl;
-                    std::pair< double, std::string > top_var_info1 = q.top();
-                    q.pop();
-                    std::pair< double, std::string > top_var_info2 = q.top();
-                    std::stringstream ss1, ss2;
-
-                    ss1.str(top_var_info1.second);
-                    ss2.str(top_var_info2.second);
-
-                    std::string temp1, temp2;
-                    std::string ro, qr;
-                    std::string gt1, ao1, gq1, qa1;
-                    std::string gt2, ao2, gq2, qa2;
-
-                    // Genotype
-                    std::getline(ss1, gt1, ',');
-                    std::getline(ss2, gt2, ',');
-                    final_var_info += gt1 + "/" + gt2 + ":";
-                    final_vcf_info += gt1 + "/" + gt2 + ":";
-
-                    if((gt1 != "0") or (gt2 != "0")) {
-                        vcf_line_data.nsa++;
-                    }
-                    vcf_line_data.ns++;
-
-                    // Depth
-                    final_var_info += std::to_string(sample_depth) + ":";
-                    final_vcf_info += std::to_string(sample_depth) + ":";
-
-                    // Allele count
-                    std::getline(ss1, ao1, ',');
-                    std::getline(ss2, ao2, ',');
-                    final_var_info += ao1 + "," + ao2 + ":";
-
-                    // Mean quality score
-                    std::getline(ss1, qa1, ',');
-                    std::getline(ss2, qa2, ',');
-                    final_var_info += temp1 + "," + temp2 + ":";
-
-                    // Mean mapq score
-                    std::getline(ss1, temp1, ',');
-                    std::getline(ss2, temp2, ',');
-                    final_var_info += temp1 + "," + temp2 + ":";
-
-                    if(gt1 != "0") {
-                        vcf_line_data.alt_ns[std::stoi(gt1.c_str()) - 1] += 1;
-                    }
-                    if(gt2 != "0") {
-                        vcf_line_data.alt_ns[std::stoi(gt2.c_str()) - 1] += 1;
-                    }
-
-                    // Ref allele count
-                    std::getline(ss1, ro, ',');
-                    final_var_info += ro + ":";
-
-                    // Mean ref allele qual score
-                    std::getline(ss1, qr, ',');
-                    final_var_info += qr;
-
-                    std::vector< int > sample_vcf_ao(vcf_line_data.ao.size(), 0);
-                    std::vector< double > sample_vcf_qa(vcf_line_data.ao.size(), 0);
-
-                    int gt1_idx = std::stoi(gt1.c_str()) - 1;
-                    int gt2_idx = std::stoi(gt2.c_str()) - 1;
-
-//                    std::cout << (j+1) << '\t' << sample << '\t' << gt1_idx << '\t' << gt2_idx << std::endl;
-
-                    if(gt1_idx >= 0) {
-                        sample_vcf_ao[gt1_idx] = std::stoi(ao1.c_str());
-                        sample_vcf_qa[gt1_idx] = std::stod(qa1.c_str());
-                        vcf_line_data.ac[gt1_idx]++;
-                    }
-                    if(gt2_idx >= 0) {
-                        sample_vcf_ao[gt2_idx] = std::stoi(ao2.c_str());
-                        sample_vcf_qa[gt2_idx] = std::stod(qa2.c_str());
-                        vcf_line_data.ac[gt2_idx]++;
-                    }
-
-                    final_vcf_info += ro;
-                    for(int i = 0; i < sample_vcf_ao.size(); ++i) {
-                        final_vcf_info += ',' + std::to_string(sample_vcf_ao[i]);
-                    }
-
-                    final_vcf_info +=  ":" + ro + ":" + qr + ":";
-                    final_vcf_info += std::to_string(sample_vcf_ao[0]);
-                    for(int i = 1; i < sample_vcf_ao.size(); ++i) {
-                        final_vcf_info += ',' + std::to_string(sample_vcf_ao[i]);
-                    }
-                    final_vcf_info += ":" + std::to_string(sample_vcf_qa[0]);
-                    for(int i = 1; i < sample_vcf_qa.size(); ++i) {
-                        final_vcf_info += ',' + std::to_string(sample_vcf_qa[i]);
-                    }
+                else {
+                    sample_ref = ref;
                 }
-                else if(q.size() == 1) {
-//                    std::cout << "\tcheck2 qsize 1" << std::endl;
-                    std::pair< double, std::string > top_var_info = q.top();
-                    std::stringstream ss;
-                    ss.str(top_var_info.second);
-                    std::string temp;
-                    std::string gt, ro, ao, gq, qr, qa;
-                    std::getline(ss, gt, ',');
-                    final_var_info += gt + "/" + gt + ":";
-                    final_vcf_info += gt + "/" + gt + ":";
-                    final_var_info += std::to_string(sample_depth) + ":";
-                    final_vcf_info += std::to_string(sample_depth) + ":";
-                    std::getline(ss, ao, ',');
-                    final_var_info += ao + "," + ao + ":";
-                    std::getline(ss, qa, ',');
-                    final_var_info += qa + "," + qa + ":";
-                    std::getline(ss, temp, ',');
-                    final_var_info += temp + "," + temp + ":";
-                    std::getline(ss, ro, ',');
-                    final_var_info += ro + ":";
-                    std::getline(ss, qr, ',');
-                    final_var_info += qr;
-
-//                    std::cout << "\t\tgt: " << gt << std::endl;
-
-                    if(gt == "0") {
-                        int sample_nucl_idx;
-                        final_vcf_info += ro;
-                        for(int i = 0; i < vcf_line_data.ao.size(); ++i) {
-                            sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(i));
-//                            std::cout << "\t\tnucl idx 1: " << sample_nucl_idx << std::endl;
-                            final_vcf_info += ',' + std::to_string((*nucl)[sample_nucl_idx][j]);
-                        }
-                        final_vcf_info += ":" + ro + ":" + qr + ":";
-                        sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(0));
-//                        std::cout << "\t\tnucl idx 2: " << sample_nucl_idx << std::endl;
-                        final_vcf_info += std::to_string((*nucl)[sample_nucl_idx][j]);
-                        for(int i = 1; i < vcf_line_data.ao.size(); ++i) {
-                            sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(i));
-//                            std::cout << "\t\tnucl idx 3: " << sample_nucl_idx << std::endl;
-                            final_vcf_info += ',' + std::to_string((*nucl)[sample_nucl_idx][j]);
-                        }
-                        sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(0));
-//                        std::cout << "\t\tnucl idx 4: " << sample_nucl_idx << std::endl;
-                        if((*nucl)[sample_nucl_idx][j] > 0) {
-                            final_vcf_info += ":" + std::to_string((double)(*qual)[sample_nucl_idx][j] /
-                                                                   (double)(*nucl)[sample_nucl_idx][j]);
-                        }
-                        else {
-                            final_vcf_info += ":.";
-                        }
-
-                        for(int i = 1; i < vcf_line_data.ao.size(); ++i) {
-                            sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(i));
-//                            std::cout << "\t\tnucl idx 5: " << sample_nucl_idx << std::endl;
-                            final_vcf_info += ',';
-                            if((*nucl)[sample_nucl_idx][j] > 0) {
-                                final_vcf_info += std::to_string((double)(*qual)[sample_nucl_idx][j] /
-                                                                 (double)(*nucl)[sample_nucl_idx][j]);
-                            }
-                            else {
-                                final_vcf_info += '.';
-                            }
-                        }
-                    }
-                    else {
-                        final_vcf_info += ro + ',' + ao + ":" + ro + ":" + qr + ":" + ao + ":" + qa;
-                    }
-
-                    vcf_line_data.ns++;
-                    if(gt != "0") {
-                        int gt_idx = std::stoi(gt.c_str()) - 1;
-                        if(gt_idx < 0) {
-//                            std::cout << "\t\tNonzero gt" << '\t' << gt_idx << '\t' << final_vcf_info << std::endl;
-                        }
-//                        std::cout << "\t\tgt_idx final: " << gt_idx << std::endl;
-                        vcf_line_data.ac[gt_idx] += 2;
-                        vcf_line_data.nsa++;
-                    }
+                if(this_parent_ref.empty()) {
+                    this_parent_ref = sample_ref;
                 }
                 else {
-//                    std::cout << "\tcheck2 qsize else" << std::endl;
-                    std::string low_depth_info = "./.:" + std::to_string(sample_depth) + ":.:.:.";
-                    positional_variants.insert({sample, low_depth_info});
-                    std::string low_vcf_info = "./.:" + std::to_string(sample_depth) + ":.";
-                    for(int i = 0; i < alts_present_at_pos.size(); ++i) {
-                        low_vcf_info += ",.";
-                    }
-                    low_vcf_info += ":.:.";
-                    for(int i = 1; i < alts_present_at_pos.size(); ++i) {
-                        low_vcf_info += ",.";
-                    }
-                    low_vcf_info += ":.:.";
-                    for(int i = 1; i < alts_present_at_pos.size(); ++i) {
-                        low_vcf_info += ",.";
+                    if(this_parent_ref != sample_ref) {
+                        std::cerr << "ERROR: All SAM files for a sample must be aligned to the same reference. If ";
+                        std::cerr << "the reference used has multiple chromosomes/segments, they must be defined in ";
+                        std::cerr << "<reference_db>.names (see documentation). Sample: " << sample;
+                        std::cerr << ", clashing references: " << this_parent_ref << ", " << sample_ref << std::endl;
+                        std::exit(EXIT_FAILURE);
                     }
-                    vcf_variants.insert({sample, low_vcf_info});
-                    continue;
                 }
-                positional_variants.insert({sample, final_var_info});
-                vcf_variants.insert({sample, final_vcf_info});
             }
-//            std::cout << "\tcheck 7.1" << std::endl;
-            ofs << this_ref << ':' << (j + 1);
-            for(int i = 0; i < ordered_sample_names.size(); ++i) {
-                ofs << '\t' << positional_variants.at(ordered_sample_names[i]);
-            }
-            ofs << std::endl;
-
-            if(position_has_major_variant) {
-                ofs2 << this_ref << ':' << (j + 1);
-                for(int i = 0; i < ordered_sample_names.size(); ++i) {
-                    ofs2 << '\t' << positional_variants.at(ordered_sample_names[i]);
-                }
-                ofs2 << std::endl;
-            }
-
-//            std::cout << "\tcheck 7.2" << std::endl;
+            parent_samples[this_parent_ref].push_back(sample);
+        }
+        for(auto &[parent_ref, samples] : parent_samples) {
+            std::sort(samples.begin(), samples.end());
+        }
 
-            vcf_line_data.qual = std::log((double)vcf_line_data.ao_sum) * (vcf_line_data.qual / (double)vcf_line_data.ao_sum);
-            for(int i = 0; i < vcf_line_data.alt.size(); ++i) {
-                vcf_line_data.af[i] = (double)vcf_line_data.ao[i] / (double)vcf_line_data.dp;
-                vcf_line_data.mqm[i] /= (double)vcf_line_data.ao[i];
-            }
-            vcf_line_data.mqmr /= (double)vcf_line_data.ro;
+        create_callers();
+        fasta_index_thread.join();
+        StageTimer timer(metrics, RunMetrics::fasta_load);
+        fasta_parser.parseFasta(all_refs);
+        timer.stop();
+        fasta_loaded = true;
+    }
 
-//            std::cout << "\tcheck 7.3" << std::endl;
+    while(num_dispatched_callers != callers.size()) {
+        dispatch_ready_callers();
+    }
 
-            vcf_writer.writeSampleData(vcf_line_data, vcf_variants);
+    // Section for large indel determination, on this thread while the callers run
+    LargeIndelFinder indel_finder(args);
+    indel_finder.findLargeIndels(concurrent_q);
 
-//            std::cout << "\tcheck final" << std::endl;
-        }
+    while(num_completed_callers != callers.size()) {
+        std::this_thread::yield();
+    }
+    if(fasta_index_thread.joinable()) {
+        fasta_index_thread.join();
     }
 
-    ofs.close();
-    ofs2.close();
-    vcf_writer.close();
+    double wall_seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - run_start).count();
+    metrics.write(args.output_dir + "/run_metrics.json", wall_seconds, args.threads);
+
     delete job_dispatcher;
     delete concurrent_q;
     delete output_buffer_dispatcher;
 
+    // Every traced thread has been joined
+    if(!args.trace_path.empty() && !TaskTrace::write(args.trace_path)) {
+        std::cerr << "WARNING: Could not write task trace: " << args.trace_path << std::endl;
+    }
+
     return 0;
 }
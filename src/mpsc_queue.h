@@ -0,0 +1,68 @@
+#ifndef SIMPLE_SNP_MPSC_QUEUE_H
+#define SIMPLE_SNP_MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+
+// Unbounded lock-free multi-producer/single-consumer queue (Vyukov's intrusive node queue).  push() is a single
+// atomic exchange, so producers never wait on each other or on the consumer, and items from one producer are
+// popped in the order it pushed them.  Only one thread may call pop().
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : _head(&_stub), _tail(&_stub) {}
+
+    ~MpscQueue()
+    {
+        T item;
+        while(pop(item)) {}
+        if(_tail != &_stub) {
+            delete _tail;
+        }
+    }
+
+    void push(T &&item)
+    {
+        Node* node = new Node(std::move(item));
+        Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // False when empty, or when the next push is between its exchange and its link (it shows up on a later call)
+    bool pop(T &item)
+    {
+        Node* tail = _tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if(next == nullptr) {
+            return false;
+        }
+        // next becomes the new stub; its item is moved out, so only the emptied node stays allocated
+        item = std::move(next->item);
+        _tail = next;
+        if(tail != &_stub) {
+            delete tail;
+        }
+        return true;
+    }
+
+    MpscQueue(const MpscQueue& rhs) = delete;
+    MpscQueue& operator=(const MpscQueue& rhs) = delete;
+
+private:
+    struct Node {
+        Node() : next(nullptr) {}
+        explicit Node(T &&this_item) : next(nullptr), item(std::move(this_item)) {}
+
+        std::atomic< Node* > next;
+        T item;
+    };
+
+    Node _stub;
+    std::atomic< Node* > _head;
+    // Consumer side only
+    Node* _tail;
+};
+
+
+#endif //SIMPLE_SNP_MPSC_QUEUE_H
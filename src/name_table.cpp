@@ -0,0 +1,37 @@
+#include "name_table.h"
+
+
+int NameTable::intern(const std::string &name)
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    auto found = _ids.find(name);
+    if(found != _ids.end()) {
+        return found->second;
+    }
+    int id = _names.size();
+    _names.push_back(name);
+    _ids[name] = id;
+    return id;
+}
+
+
+int NameTable::find(const std::string &name) const
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    auto found = _ids.find(name);
+    return (found != _ids.end()) ? found->second : -1;
+}
+
+
+const std::string& NameTable::name(const int &id) const
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    return _names.at(id);
+}
+
+
+int NameTable::size() const
+{
+    std::unique_lock< std::mutex > lock(_mtx);
+    return _names.size();
+}
@@ -0,0 +1,32 @@
+#ifndef SIMPLE_SNP_NAME_TABLE_H
+#define SIMPLE_SNP_NAME_TABLE_H
+
+#include <string>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+
+// Dense integer ids for sample or reference names, assigned in order of first sight.  Ids are never reused, so
+// containers on the hot paths are vectors indexed by id and the name is only looked up again to format output.
+// Safe to use from several threads; a name returned by name() stays valid for the table's lifetime.
+class NameTable {
+public:
+    // Id of name, assigning the next id if it has not been seen
+    int intern(const std::string &name);
+
+    // Id of name, or -1 if it has not been seen
+    int find(const std::string &name) const;
+
+    const std::string& name(const int &id) const;
+    int size() const;
+
+private:
+    mutable std::mutex _mtx;
+    std::unordered_map< std::string, int > _ids;
+    // A deque never moves its elements, so references from name() survive later interning
+    std::deque< std::string > _names;
+};
+
+
+#endif //SIMPLE_SNP_NAME_TABLE_H
@@ -0,0 +1,71 @@
+#include "packed_sequence.h"
+
+
+PackedSequence::PackedSequence() : _length(0)
+{
+
+}
+
+
+void PackedSequence::reserve(const long &len)
+{
+    _words.reserve((len + 31) / 32);
+}
+
+
+void PackedSequence::append(const char* bases, const long &len)
+{
+    for(long i = 0; i < len; ++i) {
+        uint64_t code;
+        bool masked = false;
+        switch(bases[i]) {
+            case 'A': code = 0; break;
+            case 'C': code = 1; break;
+            case 'G': code = 2; break;
+            case 'T': code = 3; break;
+            case 'a': code = 0; masked = true; break;
+            case 'c': code = 1; masked = true; break;
+            case 'g': code = 2; masked = true; break;
+            case 't': code = 3; masked = true; break;
+            default:
+                code = 0;
+                masked = true;
+                if(!_ambiguous.empty() && (_ambiguous.back().base == bases[i])
+                   && ((_ambiguous.back().start + _ambiguous.back().length) == _length)) {
+                    _ambiguous.back().length++;
+                }
+                else {
+                    _ambiguous.push_back(AmbiguousRun{_length, 1, bases[i]});
+                }
+        }
+        if((_length & 31) == 0) {
+            _words.push_back(0);
+        }
+        _words.back() |= code << ((_length & 31) << 1);
+        if(masked) {
+            _mask.resize((_length >> 6) + 1, 0);
+            _mask[_length >> 6] |= (uint64_t)1 << (_length & 63);
+        }
+        _length++;
+    }
+}
+
+
+char PackedSequence::at(const long &pos) const
+{
+    if(!_masked(pos)) {
+        return "ACGT"[_code(pos)];
+    }
+    const AmbiguousRun* run = _ambiguousRun(pos);
+    if(run != nullptr) {
+        return run->base;
+    }
+    return "acgt"[_code(pos)];
+}
+
+
+std::size_t PackedSequence::memoryBytes() const
+{
+    return ((_words.capacity() + _mask.capacity()) * sizeof(uint64_t))
+           + (_ambiguous.capacity() * sizeof(AmbiguousRun));
+}
@@ -0,0 +1,68 @@
+#ifndef SIMPLE_SNP_PACKED_SEQUENCE_H
+#define SIMPLE_SNP_PACKED_SEQUENCE_H
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+
+// Reference sequence stored at 2 bits per base (A=0, C=1, G=2, T=3, matching the pileup allele order).  Soft-masked
+// lowercase bases and any other character (N, IUPAC codes) set a bit in a mask bitmap, which only extends as far as
+// the last such base, and baseIndex() reports them as -1 so they never match an allele.  Lowercase acgt keep their
+// 2-bit code; only runs of other characters are kept in a sparse list, so they can be written back out unchanged.
+class PackedSequence {
+public:
+    PackedSequence();
+
+    void reserve(const long &len);
+    void append(const char* bases, const long &len);
+
+    long length() const { return _length; }
+    char at(const long &pos) const;
+    std::size_t memoryBytes() const;
+
+    int baseIndex(const long &pos) const
+    {
+        if(_masked(pos)) {
+            return -1;
+        }
+        return _code(pos);
+    }
+
+private:
+    struct AmbiguousRun {
+        long start;
+        long length;
+        char base;
+    };
+
+    int _code(const long &pos) const
+    {
+        return (int)((_words[pos >> 5] >> ((pos & 31) << 1)) & 3);
+    }
+
+    bool _masked(const long &pos) const
+    {
+        return ((pos >> 6) < (long)_mask.size()) && ((_mask[pos >> 6] >> (pos & 63)) & 1);
+    }
+
+    const AmbiguousRun* _ambiguousRun(const long &pos) const
+    {
+        auto it = std::upper_bound(_ambiguous.begin(), _ambiguous.end(), pos,
+                                   [](const long &p, const AmbiguousRun &run) { return p < run.start; });
+        if(it == _ambiguous.begin()) {
+            return nullptr;
+        }
+        --it;
+        return (pos < (it->start + it->length)) ? &(*it) : nullptr;
+    }
+
+    std::vector< uint64_t > _words;
+    std::vector< uint64_t > _mask;
+    std::vector< AmbiguousRun > _ambiguous;
+    long _length;
+};
+
+
+#endif //SIMPLE_SNP_PACKED_SEQUENCE_H
@@ -0,0 +1,75 @@
+#ifndef SIMPLE_SNP_PAGED_ARRAY_H
+#define SIMPLE_SNP_PAGED_ARRAY_H
+
+#include <vector>
+
+
+// Fixed-length array of counts/sums stored as fixed-size pages that are only allocated when a value is first
+// written.  Reads of a page that was never written return zero, so sparse pileups on large references cost one
+// page table entry per untouched page instead of a zero-filled array.  Reads go through the const operator[];
+// writes must use touch(), which allocates the page, so a read can never allocate by accident.
+template <typename T>
+class PagedArray {
+public:
+    static const int page_bits = 12;
+    static const long page_size = 1L << page_bits;
+
+    PagedArray() : _size(0) {}
+
+    explicit PagedArray(const long &size) : _size(size), _pages((size + page_size - 1) >> page_bits) {}
+
+    T operator[](const long &idx) const
+    {
+        const std::vector< T > &page = _pages[idx >> page_bits];
+        return page.empty() ? T() : page[idx & (page_size - 1)];
+    }
+
+    T& touch(const long &idx)
+    {
+        std::vector< T > &page = _pages[idx >> page_bits];
+        if(page.empty()) {
+            page.assign(page_size, T());
+        }
+        return page[idx & (page_size - 1)];
+    }
+
+    // Zero one value without allocating its page
+    void clear(const long &idx)
+    {
+        std::vector< T > &page = _pages[idx >> page_bits];
+        if(!page.empty()) {
+            page[idx & (page_size - 1)] = T();
+        }
+    }
+
+    long size() const
+    {
+        return _size;
+    }
+
+    long numPages() const
+    {
+        return _pages.size();
+    }
+
+    // Page contents (page_size values), or nullptr for a page that reads as zero
+    const T* page(const long &page_idx) const
+    {
+        return _pages[page_idx].empty() ? nullptr : _pages[page_idx].data();
+    }
+
+    T* touchPage(const long &page_idx)
+    {
+        if(_pages[page_idx].empty()) {
+            _pages[page_idx].assign(page_size, T());
+        }
+        return _pages[page_idx].data();
+    }
+
+private:
+    long _size;
+    std::vector< std::vector< T > > _pages;
+};
+
+
+#endif //SIMPLE_SNP_PAGED_ARRAY_H
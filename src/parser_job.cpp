@@ -2,7 +2,65 @@
 #include <fstream>
 #include <sstream>
 #include <cassert>
+#include <cstdlib>
 #include <ctype.h>
+#include <filesystem>
+#include <memory>
+#include "pileup_cache.h"
+#include "pileup_spill.h"
+
+
+// Initial ring buffer length for streaming mode; it doubles whenever a single read spans more than the window
+static const long STREAMING_WINDOW_POSITIONS = 1 << 16;
+
+// First block of an indel arena; later blocks grow geometrically from it, so files with few indels stay small
+static const std::size_t INDEL_ARENA_BYTES = 1 << 16;
+
+
+// Arena for the indel tables of one job (or one reference in streaming mode): hash nodes and count vectors are
+// bump-allocated from it and all freed together when the last pileup holding it is destroyed
+static std::shared_ptr< std::pmr::memory_resource > makeIndelArena()
+{
+    return std::make_shared< std::pmr::monotonic_buffer_resource >(INDEL_ARENA_BYTES);
+}
+
+
+// Number of reference positions covered by an alignment
+static long cigarReferenceSpan(const std::string &cigar)
+{
+    long span = 0;
+    long num = 0;
+    for(int i = 0; i < cigar.length(); ++i) {
+        if(std::isdigit(cigar[i])) {
+            num = (num * 10) + (cigar[i] - '0');
+            continue;
+        }
+        if((cigar[i] == 'M') || (cigar[i] == 'D') || (cigar[i] == 'N') || (cigar[i] == '=') || (cigar[i] == 'X')) {
+            span += num;
+        }
+        num = 0;
+    }
+    return span;
+}
+
+
+// Rebuild ring buffer arrays with a larger power of two length, keeping the live positions from window_start
+template <typename T>
+static void regrowRing(std::vector< PagedArray< T > > &arrays,
+                       const long &window_start,
+                       const long &old_mask,
+                       const long &new_mask)
+{
+    for(int i = 0; i < arrays.size(); ++i) {
+        PagedArray< T > grown(new_mask + 1);
+        for(long j = window_start; j < (window_start + old_mask + 1); ++j) {
+            if(arrays[i][j & old_mask] != 0) {
+                grown.touch(j & new_mask) = arrays[i][j & old_mask];
+            }
+        }
+        arrays[i] = std::move(grown);
+    }
+}
 
 
 ParserJob::ParserJob(const std::string &parameter_string,
@@ -20,6 +78,22 @@ ParserJob::ParserJob(const std::string &parameter_string,
 
 ParserJob::~ParserJob()
 {
+    if(_reader) {
+        // Stop the reader stage first so its timings are final
+        _reader->close();
+        long parse_ns = std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now()
+                                                                               - _parse_start).count();
+        RunMetrics &metrics = _buffer_q->metrics;
+        metrics.input_read_ns += _reader->reader_busy_ns;
+        metrics.input_read_stall_ns += _reader->reader_stall_ns;
+        metrics.input_parse_ns += parse_ns - _reader->parser_stall_ns;
+        metrics.input_parse_stall_ns += _reader->parser_stall_ns;
+        metrics.num_input_pipelines += 1;
+    }
+    _buffer_q->metrics.num_reads += num_reads;
+    _buffer_q->metrics.num_bases += num_bases;
+    _buffer_q->metrics.num_depth_skipped_reads += depth_skipped_reads;
+    _buffer_q->completeParse(sam_filepath);
     _buffer_q->num_active_jobs -= 1;
     _buffer_q->num_completed_jobs += 1;
 }
@@ -28,7 +102,10 @@ ParserJob::~ParserJob()
 void ParserJob::printInfo()
 {
     std::cout << std::endl;
-    std::cout << samplename << '\t' << sam_sampleid << '\t' << sam_readgroup << '\t' << sam_filepath << std::endl;
+    for(const SamplePileup &pileup : pileups) {
+        std::cout << samplename << '\t' << pileup.sample_id << '\t' << pileup.readgroup << '\t' << sam_filepath;
+        std::cout << std::endl;
+    }
     for(int i = 0; i < this_children_ref.size(); ++i) {
         std::cout << '\t' << this_children_ref[i] << '\t' << ref_lens[i] << std::endl;
     }
@@ -39,159 +116,306 @@ void ParserJob::printInfo()
 
 void ParserJob::run()
 {
-    std::string this_header, line;
-    std::ifstream ifs(sam_filepath, std::ios::in);
-
-    if(!ifs.good()) {
-        return;
-    }
-
-    this_header = "";
-    this_parent_ref = "";
-    bool headers = false;
-    bool readgroup_present = false;
-    bool ref_info_present = false;
-    while(!headers) {
-        std::getline(ifs, line);
-
-        if(line.empty()) {
-            return;
-        }
-
-        if(line.at(0) == '@') {
-            if(line.substr(0, 3) == "@SQ") {
-                ref_info_present = true;
-                std::stringstream ss_sq;
-                std::string sq_part;
-                ss_sq.str(line);
-                std::getline(ss_sq, sq_part, '\t');
-                std::getline(ss_sq, sq_part, '\t');
-                reference_name = sq_part.substr(3);
-                std::getline(ss_sq, sq_part);
-                std::string this_len_part = sq_part.substr(3);
-                if(!_args.db_names_file.empty()) {
-                    if(!_args.rev_db_parent_map.count(reference_name)) {
-                        std::cerr << "ERROR: <reference_db>.names file present, but this reference was not detected ";
-                        std::cerr << "in the <reference_db>.names file, provided: " << reference_name << std::endl;
-                        std::exit(EXIT_FAILURE);
-                    }
-                    if(!this_parent_ref.empty()) {
-                        if(_args.rev_db_parent_map.at(reference_name) != this_parent_ref) {
-                            std::cerr << "ERROR: Multiple reference contigs detected that belong to different parent";
-                            std::cerr << " relationships. Reads must be aligned to contigs belonging to either a ";
-                            std::cerr << "single reference genome or a genome with multiple contigs/segments, whose ";
-                            std::cerr << "relations are defined in <reference_db>.names file (see documentation).";
-                            std::cerr << "SAM file: " << sam_filepath << std::endl;
-                            std::exit(EXIT_FAILURE);
-                        }
-                    }
-                    else {
-                        this_parent_ref = _args.rev_db_parent_map.at(reference_name);
-                    }
-                }
-                else {
-                    if(!this_parent_ref.empty()) {
-                        std::cerr << "ERROR: Multiple reference genomes are only supported if the <reference_db>.names";
-                        std::cerr << " file is also present, which defines relations between parent organisms and ";
-                        std::cerr << "their children chromosomes/segments (see documentation). SAM file: ";
-                        std::cerr << sam_filepath << std::endl;
-                        std::exit(EXIT_FAILURE);
-                    }
-                    this_parent_ref = reference_name;
-                }
-                this_children_ref.push_back(reference_name);
-                ref_lens.push_back(std::stol(this_len_part.c_str()));
+    // Pileups do not depend on the calling thresholds, so a run with the same SAM, reference and parse options can
+    // reuse the cached pileup and skip parsing entirely
+    std::unique_ptr< PileupCache > cache;
+    if(!_args.pileup_cache_dir.empty() && !SamReader::isStream(sam_filepath)) {
+        cache = std::make_unique< PileupCache >(pileupCachePath(_args, sam_filepath, samplename),
+                                                pileupCacheKey(sam_filepath, _args));
+        if(cache->load(this_children_ref, ref_lens, pileups)) {
+            if(_buffer_q->input_prefetcher != nullptr) {
+                _buffer_q->input_prefetcher->discard(sam_filepath);
             }
-
-            if(line.substr(0, 3) == "@RG") {
-                std::stringstream ss_rg;
-                std::string rg_part;
-                ss_rg.str(line);
-                std::getline(ss_rg, rg_part, '\t');
-                std::getline(ss_rg, rg_part, '\t');
-                sam_readgroup = rg_part.substr(3);
-                std::getline(ss_rg, rg_part);
-                sam_sampleid = rg_part.substr(3);
-                readgroup_present = true;
+            for(int p = 0; p < pileups.size(); ++p) {
+                if(!std::filesystem::exists(_positionalDataPath(p))) {
+                    _writePositionalData(p);
+                }
             }
+            _pushResults();
+            return;
         }
-        else {
-            headers = true;
-        }
+        this_children_ref.clear();
+        ref_lens.clear();
+        pileups.clear();
     }
 
-    if(!readgroup_present) {
-        std::cerr << "ERROR: Readgroup information (@RG) is not present in SAM file (" << sam_filepath << ").";
-        std::cerr << " @RG ID and SM must be set." << std::endl;
-        std::exit(EXIT_FAILURE);
+    std::string line;
+    std::vector< char > contents;
+    if((_buffer_q->input_prefetcher != nullptr) && _buffer_q->input_prefetcher->take(sam_filepath, contents)) {
+        _reader = std::make_unique< SamReader >(sam_filepath,
+                                                _args.read_ahead_blocks,
+                                                SamReader::block_bytes,
+                                                std::move(contents));
+    }
+    else {
+        _reader = std::make_unique< SamReader >(sam_filepath, _args.read_ahead_blocks, SamReader::block_bytes);
     }
+    _parse_start = std::chrono::steady_clock::now();
+    SamReader &reader = *_reader;
 
-    if(!ref_info_present) {
-        std::cerr << "ERROR: Reference sequence information (@SQ) is not present in SAM file (" << sam_filepath << ").";
-        std::cerr << " @SQ SN and LN must be present only once (one contig in reference file)." << std::endl;
-        std::exit(EXIT_FAILURE);
+    if(!reader.good()) {
+        return;
     }
+    _buffer_q->metrics.num_sam_files += 1;
 
-    for(int i = 0; i < this_children_ref.size(); ++i) {
-        if(ref_lens[i] <= 0) {
-            std::cerr << "ERROR: Reference sequence length is not positive, provided: ";
-            std::cerr << this_children_ref[i] << ", " << ref_lens[i] << std::endl;
-            std::exit(EXIT_FAILURE);
+    StageTimer header_timer(_buffer_q->metrics, RunMetrics::header_parse);
+    SamHeader header(sam_filepath);
+    if(!header.read(reader, line)) {
+        return;
+    }
+    header.validate(_args);
+    header_timer.stop();
+    this_parent_ref = header.parent_ref;
+    this_children_ref = header.refs;
+    ref_lens = header.ref_lens;
+    reference_name = header.refs.back();
+
+    for(int g = 0; g < header.readgroups.size(); ++g) {
+        // Read groups of the same sample share its pileup
+        int pileup_idx = 0;
+        while((pileup_idx < pileups.size()) && (pileups[pileup_idx].sample_id != header.readgroup_samples[g])) {
+            pileup_idx++;
+        }
+        if(pileup_idx == pileups.size()) {
+            pileups.emplace_back();
+            pileups.back().sample_id = header.readgroup_samples[g];
         }
+        pileups[pileup_idx].readgroup = header.readgroups[g];
+        _readgroup_pileups[header.readgroups[g]] = pileup_idx;
     }
 
+    for(int r = 0; r < this_children_ref.size(); ++r) {
+        _ref_idxs[this_children_ref[r]] = r;
+    }
+    // Coordinate-sorted input feeding out-of-core calling never needs whole-reference arrays: positions are final
+    // once reads start past them, so they are flushed from a sliding window straight to the output files.  The
+    // window holds a single sample, so files with several @RG samples take the whole-reference path below.
+    if(header.coordinate_sorted && !_buffer_q->spill_dir.empty() && (pileups.size() == 1)) {
+        _runStreaming(reader, line);
+        return;
+    }
 
-    for(int i = 0; i < this_children_ref.size(); ++i) {
-        nucleotide_counts[this_children_ref[i]] = std::vector< std::vector< int > >(_iupac_map.size(),
-                                                                                     std::vector< int >(ref_lens[i], 0));
-        qual_sums[this_children_ref[i]] = std::vector< std::vector< long > >(_iupac_map.size(),
-                                                                             std::vector< long >(ref_lens[i], 0));
-        mapq_sums[this_children_ref[i]] = std::vector< std::vector< long > >(_iupac_map.size(),
-                                                                             std::vector< long >(ref_lens[i], 0));
-        insertions[this_children_ref[i]];
-        deletions[this_children_ref[i]];
+    // The parse is single-threaded, so every pileup of the job shares one (unsynchronized) arena
+    std::shared_ptr< std::pmr::memory_resource > indel_arena = makeIndelArena();
+    for(SamplePileup &pileup : pileups) {
+        pileup.refs.clear();
+        pileup.refs.reserve(this_children_ref.size());
+        for(int i = 0; i < this_children_ref.size(); ++i) {
+            // Pages are allocated as reads land on them, so untouched stretches of large references cost nothing
+            RefPileup &ref_pileup = pileup.refs.emplace_back(indel_arena);
+            ref_pileup.nucleotide_counts = std::vector< PagedArray< int > >(_iupac_map.size(),
+                                                                            PagedArray< int >(ref_lens[i]));
+            ref_pileup.qual_sums = std::vector< PagedArray< long > >(_iupac_map.size(),
+                                                                    PagedArray< long >(ref_lens[i]));
+            ref_pileup.mapq_sums = std::vector< PagedArray< long > >(_iupac_map.size(),
+                                                                    PagedArray< long >(ref_lens[i]));
+        }
     }
 
+    // Waits on the reader stage are left out of the parse time; they are reported with the input pipeline
+    StageTimer parse_timer(_buffer_q->metrics, RunMetrics::read_parse);
+    long start_stall_ns = reader.parser_stall_ns;
+
+    // Reused for every read, so once its strings have grown to the longest SEQ/QUAL, splitting allocates nothing
     std::vector< std::string > res;
-    int sam_flag;
     //      0          1           2            3     4    5     6
     // < sam flag, ref name, start pos 1-idx, mapq, cigar, seq, qual >
-    res = _parseSamLine(line);
+    _parseSamLine(line, res);
     if((res.size() == 0) || (res[0].empty())) {
         return;
     }
-    sam_flag = std::stoi(res[0].c_str());
-    if(((sam_flag & 4) == 0) and ((sam_flag & 256) == 0) and ((sam_flag & 2048) == 0)) {
+    num_reads++;
+    if(_passesReadFilters(line)) {
         // Primary alignment
-        _addAlignedRead(res[1], res[4], res[5], res[6], std::stol(res[2].c_str()), std::stoi(res[3].c_str()));
+        int pileup_idx = _readPileup(line);
+        int ref_idx = _readRef(res[1]);
+        if(_admitRead(pileup_idx, ref_idx, std::stol(res[2].c_str()))) {
+            _addAlignedRead(pileups[pileup_idx].refs[ref_idx],
+                            res[4],
+                            res[5],
+                            res[6],
+                            std::stol(res[2].c_str()),
+                            std::stoi(res[3].c_str()));
+        }
     }
 
-    while(std::getline(ifs, line)) {
-        res = _parseSamLine(line);
-        sam_flag = std::stoi(res[0].c_str());
-        if(((sam_flag & 4) == 0) and ((sam_flag & 256) == 0) and ((sam_flag & 2048) == 0)) {
-            // Primary alignment
-            _addAlignedRead(res[1], res[4], res[5], res[6], std::stol(res[2].c_str()), std::stoi(res[3].c_str()));
+    while(reader.getline(line)) {
+        num_reads++;
+        if(!_passesReadFilters(line)) {
+            continue;
+        }
+        // Primary alignment
+        _parseSamLine(line, res);
+        int pileup_idx = _readPileup(line);
+        int ref_idx = _readRef(res[1]);
+        if(_admitRead(pileup_idx, ref_idx, std::stol(res[2].c_str()))) {
+            _addAlignedRead(pileups[pileup_idx].refs[ref_idx],
+                            res[4],
+                            res[5],
+                            res[6],
+                            std::stol(res[2].c_str()),
+                            std::stoi(res[3].c_str()));
         }
     }
+    parse_timer.stop(reader.parser_stall_ns - start_stall_ns);
 
-    _writePositionalData();
+    for(int p = 0; p < pileups.size(); ++p) {
+        _writePositionalData(p);
+    }
 
 //    printInfo();
 
-    for(auto &[ref, nucl] : nucleotide_counts) {
-        while(!_buffer_q->tryPush(sam_sampleid,
-                                  ref,
-                                  nucl,
-                                  qual_sums.at(ref),
-                                  mapq_sums.at(ref),
-                                  insertions.at(ref),
-                                  deletions.at(ref))) {}
+    if(cache) {
+        cache->save(this_children_ref, ref_lens, pileups);
+    }
+
+    _pushResults();
+}
+
+
+std::string ParserJob::pileupName(const std::string &sam_filepath, const std::string &samplename)
+{
+    std::size_t path_hash = std::hash< std::string >{}(sam_filepath);
+    std::stringstream pileup_name;
+    pileup_name << samplename << '_' << std::hex << path_hash;
+    return pileup_name.str();
+}
+
+
+std::string ParserJob::pileupCachePath(const Args &args,
+                                       const std::string &sam_filepath,
+                                       const std::string &samplename)
+{
+    // Cohort store entries are keyed by sample alone, so a reparse of a sample whose SAM file moved replaces its
+    // entry instead of adding a second one
+    if(!args.cohort_store_dir.empty()) {
+        return args.cohort_store_dir + '/' + samplename + ".pileup";
+    }
+    return args.pileup_cache_dir + '/' + pileupName(sam_filepath, samplename) + ".pileup";
+}
+
+
+std::string ParserJob::pileupCacheKey(const std::string &sam_filepath, const Args &args)
+{
+    // SAM identity (path, size, mtime) plus everything else that changes the pileup
+    return PileupCache::fileKey(sam_filepath) + '|' + pileupOptionsKey(args);
+}
+
+
+std::string ParserJob::pileupOptionsKey(const Args &args)
+{
+    std::string key = args.reference_path;
+    // Parse options are appended only when set, so pileups cached without them stay valid
+    if(args.max_depth > 0) {
+        key += "|max_depth=" + std::to_string(args.max_depth);
+    }
+    if(args.min_mapq > 0) {
+        key += "|min_mapq=" + std::to_string(args.min_mapq);
+    }
+    if(args.min_base_qual > 0) {
+        key += "|min_base_qual=" + std::to_string(args.min_base_qual);
+    }
+    return key;
+}
+
+
+void ParserJob::_pushResults()
+{
+    StageTimer timer(_buffer_q->metrics, RunMetrics::pileup_push);
+    _buffer_q->pushPileups(pileupName(sam_filepath, samplename), this_children_ref, ref_lens, std::move(pileups));
+}
+
+
+bool ParserJob::_passesReadFilters(const std::string &sam_line)
+{
+    // First stage of tokenization: FLAG (column 2) and MAPQ (column 5) are read in place, so unmapped, secondary,
+    // supplementary and low-MAPQ reads are rejected before the line is split and SEQ/QUAL are copied
+    std::size_t tab = sam_line.find('\t');
+    if(tab == std::string::npos) {
+        return false;
+    }
+    long sam_flag = std::strtol(sam_line.c_str() + tab + 1, nullptr, 10);
+    if(((sam_flag & 4) != 0) or ((sam_flag & 256) != 0) or ((sam_flag & 2048) != 0)) {
+        return false;
+    }
+    if(_args.min_mapq > 0) {
+        for(int field = 2; field < 5; ++field) {
+            tab = sam_line.find('\t', tab + 1);
+            if(tab == std::string::npos) {
+                return false;
+            }
+        }
+        if(std::strtol(sam_line.c_str() + tab + 1, nullptr, 10) < _args.min_mapq) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int ParserJob::_readPileup(const std::string &sam_line)
+{
+    if(pileups.size() == 1) {
+        return 0;
+    }
+    std::size_t tag = sam_line.find("\tRG:Z:");
+    if(tag == std::string::npos) {
+        std::cerr << "ERROR: Read without an RG:Z: tag in a SAM file with multiple @RG samples, SAM file: ";
+        std::cerr << sam_filepath << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    tag += 6;
+    std::string readgroup = sam_line.substr(tag, sam_line.find('\t', tag) - tag);
+    auto found = _readgroup_pileups.find(readgroup);
+    if(found == _readgroup_pileups.end()) {
+        std::cerr << "ERROR: Read group is not declared in the @RG header, SAM file: " << sam_filepath;
+        std::cerr << ", read group: " << readgroup << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    return found->second;
+}
+
+
+int ParserJob::_readRef(const std::string &ref)
+{
+    auto found = _ref_idxs.find(ref);
+    if(found == _ref_idxs.end()) {
+        std::cerr << "ERROR: Read aligned to a reference that is not in the @SQ header, SAM file: ";
+        std::cerr << sam_filepath << ", reference: " << ref << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    return found->second;
+}
+
+
+bool ParserJob::_admitRead(const int &pileup_idx, const int &ref_idx, const long &pos)
+{
+    if(_args.max_depth <= 0) {
+        return true;
+    }
+    const RefPileup &ref_pileup = _streaming_ref ? *_streaming_ref : pileups[pileup_idx].refs[ref_idx];
+    const std::vector< PagedArray< int > > &nucl = ref_pileup.nucleotide_counts;
+    long idx = (pos - 1) & _window_mask;
+    if(nucl.empty() || (idx < 0) || (idx >= nucl[0].size())) {
+        return true;
+    }
+    long depth = 0;
+    for(int i = 0; i < nucl.size(); ++i) {
+        depth += nucl[i][idx];
     }
+    // Input-order truncation, not sampling: once coverage at a read's start position reaches the cap, every later
+    // read starting there is skipped, so the reads kept are the first ones in the file (whatever order that is, e.g.
+    // by name or tile).  Only the start position is checked, so reads starting upstream can still take coverage
+    // further along past the cap.
+    if(depth < _args.max_depth) {
+        return true;
+    }
+    depth_skipped_reads++;
+    return false;
 }
 
 
-void ParserJob::_addAlignedRead(const std::string &ref,
+void ParserJob::_addAlignedRead(RefPileup &ref_pileup,
                                 const std::string &cigar,
                                 const std::string &seq,
                                 const std::string &qual,
@@ -207,6 +431,7 @@ void ParserJob::_addAlignedRead(const std::string &ref,
     if(seq == "*") {
         return;
     }
+    num_bases += seq.size();
     while(cigar_idx < cigar.length()) {
         if(std::isdigit(cigar.at(cigar_idx))) {
             num += cigar.at(cigar_idx);
@@ -215,6 +440,8 @@ void ParserJob::_addAlignedRead(const std::string &ref,
             op = cigar.at(cigar_idx);
             int numeric_num = std::stoi(num.c_str());
             if((op == "M") or (op == "=") or (op == "X")) {
+                // Array slot of target_idx: the index itself for whole-reference arrays (_window_mask is all
+                // ones), or its place in the streaming ring buffer
                 for(int i = 0; i < numeric_num; ++i) {
                     if(read_idx >= seq.size()) {
                         std::cerr << "Out of bounds: " << sam_filepath << std::endl;
@@ -222,31 +449,29 @@ void ParserJob::_addAlignedRead(const std::string &ref,
                         std::cerr << qual << std::endl;
                         std::exit(EXIT_FAILURE);
                     }
-                    if(!_iupac_map.count(seq.at(read_idx))) {
+                    auto base = _iupac_map.find(seq.at(read_idx));
+                    if((base == _iupac_map.end()) || ((int(qual.at(read_idx)) - 33) < _args.min_base_qual)) {
                         read_idx++;
                         target_idx++;
                         continue;
                     }
-                    nucleotide_counts.at(ref)[_iupac_map.at(seq.at(read_idx))][target_idx]++;
-                    qual_sums.at(ref)[_iupac_map.at(seq.at(read_idx))][target_idx] += int(qual.at(read_idx)) - 33;  // Phred 33
-                    mapq_sums.at(ref)[_iupac_map.at(seq.at(read_idx))][target_idx] += mapq;
+                    ref_pileup.nucleotide_counts[base->second].touch(target_idx & _window_mask)++;
+                    ref_pileup.qual_sums[base->second].touch(target_idx & _window_mask) += int(qual.at(read_idx)) - 33;  // Phred 33
+                    ref_pileup.mapq_sums[base->second].touch(target_idx & _window_mask) += mapq;
                     read_idx++;
                     target_idx++;
                 }
             }
             else if(op == "D") {
-                if(!deletions.at(ref).count(target_idx)) {
-                    std::unordered_map< int, std::vector< long > > this_template{{numeric_num, std::vector< long >(3, 0)}};
-                    deletions.at(ref)[target_idx] = this_template;
-                }
-                if(!deletions.at(ref).at(target_idx).count(numeric_num)) {
-                    deletions.at(ref).at(target_idx)[numeric_num] = std::vector< long >(3, 0);
+                // New entries are built in the table's own resource (the job's arena)
+                std::pmr::vector< long > &this_del_vec = ref_pileup.deletions[target_idx][numeric_num];
+                if(this_del_vec.empty()) {
+                    this_del_vec.resize(3, 0);
                 }
-                std::vector< long > *this_del_vec = &deletions.at(ref).at(target_idx).at(numeric_num);
-                (*this_del_vec)[0]++;
-                (*this_del_vec)[1] += qual.at(read_idx);
+                this_del_vec[0]++;
+                this_del_vec[1] += qual.at(read_idx);
                 if((read_idx + 1) < seq.length()) {
-                    (*this_del_vec)[2] += qual.at(read_idx + 1);
+                    this_del_vec[2] += qual.at(read_idx + 1);
                 }
                 target_idx += numeric_num;
             }
@@ -254,21 +479,17 @@ void ParserJob::_addAlignedRead(const std::string &ref,
                 target_idx += numeric_num;
             }
             else if(op == "I") {
-                if(!insertions.at(ref).count(target_idx)) {
-                    std::unordered_map< int, std::vector< long > > this_template{{numeric_num, std::vector< long >(4, 0)}};
-                    insertions.at(ref)[target_idx] = this_template;
-                }
-                if(!insertions.at(ref).at(target_idx).count(numeric_num)) {
-                    insertions.at(ref).at(target_idx)[numeric_num] = std::vector< long >(4, 0);
+                std::pmr::vector< long > &this_ins_vec = ref_pileup.insertions[target_idx][numeric_num];
+                if(this_ins_vec.empty()) {
+                    this_ins_vec.resize(4, 0);
                 }
-                std::vector< long > *this_ins_vec = &insertions.at(ref).at(target_idx).at(numeric_num);
-                (*this_ins_vec)[0]++;
+                this_ins_vec[0]++;
                 for(int s = 0; s < numeric_num; ++s) {
-                    (*this_ins_vec)[1] += qual.at(read_idx + s);
+                    this_ins_vec[1] += qual.at(read_idx + s);
                 }
-                (*this_ins_vec)[2] += qual.at(read_idx);
+                this_ins_vec[2] += qual.at(read_idx);
                 if((read_idx + numeric_num) < seq.length()) {
-                    (*this_ins_vec)[3] += qual.at(read_idx + numeric_num);
+                    this_ins_vec[3] += qual.at(read_idx + numeric_num);
                 }
                 read_idx += numeric_num;
             }
@@ -282,86 +503,289 @@ void ParserJob::_addAlignedRead(const std::string &ref,
 }
 
 
-std::vector< std::string > ParserJob::_parseSamLine(const std::string &sam_line)
+void ParserJob::_parseSamLine(const std::string &sam_line, std::vector< std::string > &fields)
 {
     //      0          1           2            3     4    5     6
     // < sam flag, ref name, start pos 1-idx, mapq, cigar, seq, qual >
-    std::vector< std::string > ret;
-    std::stringstream this_ss;
-    this_ss.str(sam_line);
-    std::string this_entry;
-    std::getline(this_ss, this_entry, '\t');  // 0. read name
-    std::getline(this_ss, this_entry, '\t');  // 1. sam flag
-    ret.push_back(this_entry);
-    std::getline(this_ss, this_entry, '\t');  // 2. ref name
-    ret.push_back(this_entry);
-    std::getline(this_ss, this_entry, '\t');  // 3. start pos 1-idx
-    ret.push_back(this_entry);
-    std::getline(this_ss, this_entry, '\t');  // 4. mapq
-    ret.push_back(this_entry);
-    std::getline(this_ss, this_entry, '\t');  // 5. cigar
-    ret.push_back(this_entry);
-    std::getline(this_ss, this_entry, '\t');  // 6. rnext
-    std::getline(this_ss, this_entry, '\t');  // 7. pnext
-    std::getline(this_ss, this_entry, '\t');  // 8. tlen
-    std::getline(this_ss, this_entry, '\t');  // 9. seq
-    ret.push_back(this_entry);
-    std::getline(this_ss, this_entry, '\t');  // 10. qual
-    ret.push_back(this_entry);
-    return ret;
+    // SAM columns (0-idx) of the fields; read name, rnext, pnext and tlen are skipped without being copied
+    static const int columns[] = {1, 2, 3, 4, 5, 9, 10};
+    fields.resize(7);
+    std::size_t start = 0;
+    int column = 0;
+    for(int f = 0; f < fields.size(); ++f) {
+        std::size_t stop = 0;
+        while(start <= sam_line.size()) {
+            stop = std::min(sam_line.find('\t', start), sam_line.size());
+            if(column == columns[f]) {
+                break;
+            }
+            start = stop + 1;
+            column++;
+        }
+        if(start > sam_line.size()) {
+            // Truncated line: the missing columns are empty
+            fields[f].clear();
+            continue;
+        }
+        // Assigned in place, so the string keeps its capacity from earlier reads
+        fields[f].assign(sam_line, start, stop - start);
+        start = stop + 1;
+        column++;
+    }
 }
 
 
-void ParserJob::_writePositionalData()
+std::string ParserJob::_positionalDataPath(const int &pileup_idx)
 {
-    std::string outfile_path = _output_dir + "/" + samplename + "_positional_data.tsv";
-    std::ofstream ofs(outfile_path);
+    if(pileups.size() > 1) {
+        return _output_dir + "/" + samplename + '_' + pileups[pileup_idx].sample_id + "_positional_data.tsv";
+    }
+    return _output_dir + "/" + samplename + "_positional_data.tsv";
+}
 
-    ofs << "Reference:Index\tA_count,C_count,G_count,T_count\tA_avg_qual,C_avg_qual,G_avg_qual,T_avg_qual\t";
-    ofs << "A_avg_mapq,C_avg_mapq,G_avg_mapq,T_avg_mapq" << std::endl;
 
+void ParserJob::_writePositionalData(const int &pileup_idx)
+{
+    StageTimer timer(_buffer_q->metrics, RunMetrics::positional_write);
+    std::ofstream ofs(_positionalDataPath(pileup_idx));
+
+    _writePositionalHeader(ofs);
     for(int r = 0; r < this_children_ref.size(); ++r) {
-        std::string ref = this_children_ref[r];
         for(int j = 0; j < ref_lens[r]; ++j) {
-            ofs << ref << ':' << (j + 1) << "\t" << nucleotide_counts.at(ref)[0][j];
-            for(int i = 1; i < _iupac_map.size(); ++i) {
-                ofs << "," << nucleotide_counts.at(ref)[i][j];
-            }
+            _writePositionalLine(ofs, pileups[pileup_idx].refs[r], this_children_ref[r], j, j);
+        }
+    }
 
-            if(nucleotide_counts.at(ref)[0][j] > 0) {
-                ofs << "\t" << ((double)qual_sums.at(ref)[0][j] / (double)nucleotide_counts.at(ref)[0][j]);
-            }
-            else {
-                ofs << "\t0";
-            }
+    _buffer_q->metrics.bytes_written += (long)ofs.tellp();
+    ofs.close();
+}
+
+
+void ParserJob::_writePositionalHeader(std::ofstream &ofs)
+{
+    ofs << "Reference:Index\tA_count,C_count,G_count,T_count\tA_avg_qual,C_avg_qual,G_avg_qual,T_avg_qual\t";
+    ofs << "A_avg_mapq,C_avg_mapq,G_avg_mapq,T_avg_mapq" << std::endl;
+}
+
+
+void ParserJob::_writePositionalLine(std::ofstream &ofs,
+                                     const RefPileup &ref_pileup,
+                                     const std::string &ref,
+                                     const long &pos,
+                                     const long &idx)
+{
+    const std::vector< PagedArray< int > > &nucl = ref_pileup.nucleotide_counts;
+    const std::vector< PagedArray< long > > &qual = ref_pileup.qual_sums;
+    const std::vector< PagedArray< long > > &mapq = ref_pileup.mapq_sums;
+    ofs << ref << ':' << (pos + 1) << "\t" << nucl[0][idx];
+    for(int i = 1; i < _iupac_map.size(); ++i) {
+        ofs << "," << nucl[i][idx];
+    }
+
+    if(nucl[0][idx] > 0) {
+        ofs << "\t" << ((double)qual[0][idx] / (double)nucl[0][idx]);
+    }
+    else {
+        ofs << "\t0";
+    }
+
+    for(int i = 1; i < _iupac_map.size(); ++i) {
+        if(nucl[i][idx] > 0) {
+            ofs << "," << ((double)qual[i][idx] / (double)nucl[i][idx]);
+        }
+        else {
+            ofs << ",0";
+        }
+    }
+
+    if(nucl[0][idx] > 0) {
+        ofs << "\t" << ((double)mapq[0][idx] / (double)nucl[0][idx]);
+    }
+    else {
+        ofs << "\t0";
+    }
+
+    for(int i = 1; i < _iupac_map.size(); ++i) {
+        if(nucl[i][idx] > 0) {
+            ofs << "," << ((double)mapq[i][idx] / (double)nucl[i][idx]);
+        }
+        else {
+            ofs << ",0";
+        }
+    }
+    ofs << std::endl;
+}
 
-            for(int i = 1; i < _iupac_map.size(); ++i) {
-                if(nucleotide_counts.at(ref)[i][j] > 0) {
-                    ofs << "," << ((double)qual_sums.at(ref)[i][j] / (double)nucleotide_counts.at(ref)[i][j]);
-                }
-                else {
-                    ofs << ",0";
-                }
-            }
 
-            if(nucleotide_counts.at(ref)[0][j] > 0) {
-                ofs << "\t" << ((double)mapq_sums.at(ref)[0][j] / (double)nucleotide_counts.at(ref)[0][j]);
+void ParserJob::_runStreaming(SamReader &reader, const std::string &first_line)
+{
+    std::vector< std::string > res;
+    _parseSamLine(first_line, res);
+    if((res.size() == 0) || (res[0].empty())) {
+        return;
+    }
+    // Includes flushing the window to the spill and positional files as reads move past it
+    StageTimer parse_timer(_buffer_q->metrics, RunMetrics::read_parse);
+    long start_stall_ns = reader.parser_stall_ns;
+
+    std::string spill_path = _buffer_q->spillPath(pileupName(sam_filepath, samplename));
+    _spill_writer = std::make_unique< PileupSpillWriter >(spill_path,
+                                                          pileups[0].sample_id,
+                                                          this_children_ref,
+                                                          ref_lens);
+    if(!_args.pileup_cache_dir.empty() && !SamReader::isStream(sam_filepath)) {
+        _cache_writer = std::make_unique< PileupCacheWriter >(pileupCachePath(_args, sam_filepath, samplename),
+                                                              pileupCacheKey(sam_filepath, _args),
+                                                              pileups[0].sample_id,
+                                                              pileups[0].readgroup,
+                                                              this_children_ref,
+                                                              ref_lens);
+    }
+    _positional_ofs.open(_positionalDataPath(0));
+    _writePositionalHeader(_positional_ofs);
+
+    int ref_idx = -1;
+    long prev_start = 0;
+    std::string line = first_line;
+    do {
+        num_reads++;
+        if(_passesReadFilters(line)) {
+            // Primary alignment
+            _parseSamLine(line, res);
+            int read_ref_idx = _readRef(res[1]);
+            long start = std::stol(res[2].c_str()) - 1;
+            if((read_ref_idx < ref_idx) || ((read_ref_idx == ref_idx) && (start < prev_start))) {
+                std::cerr << "ERROR: SAM file header declares SO:coordinate but reads are not sorted, SAM file: ";
+                std::cerr << sam_filepath << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            while(ref_idx < read_ref_idx) {
+                if(ref_idx >= 0) {
+                    _endStreamingRef(ref_idx);
+                }
+                ref_idx++;
+                _beginStreamingRef(ref_idx);
             }
-            else {
-                ofs << "\t0";
+            prev_start = start;
+            _advanceWindow(ref_idx, start, cigarReferenceSpan(res[4]));
+            if(_admitRead(0, ref_idx, start + 1)) {
+                _addAlignedRead(*_streaming_ref, res[4], res[5], res[6], start + 1, std::stoi(res[3].c_str()));
             }
+        }
+    } while(reader.getline(line));
 
-            for(int i = 1; i < _iupac_map.size(); ++i) {
-                if(nucleotide_counts.at(ref)[i][j] > 0) {
-                    ofs << "," << ((double)mapq_sums.at(ref)[i][j] / (double)nucleotide_counts.at(ref)[i][j]);
-                }
-                else {
-                    ofs << ",0";
-                }
+    // References after the last aligned read have zero depth throughout
+    while(ref_idx < (int)this_children_ref.size()) {
+        if(ref_idx >= 0) {
+            _endStreamingRef(ref_idx);
+        }
+        ref_idx++;
+        if(ref_idx < this_children_ref.size()) {
+            _beginStreamingRef(ref_idx);
+        }
+    }
+
+    parse_timer.stop(reader.parser_stall_ns - start_stall_ns);
+
+    _buffer_q->metrics.bytes_written += (long)_positional_ofs.tellp();
+    _positional_ofs.close();
+    if(_cache_writer) {
+        _cache_writer->close();
+    }
+    if(!_spill_writer->close()) {
+        std::cerr << "ERROR: Could not write pileup spill file: " << spill_path << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    for(int r = 0; r < this_children_ref.size(); ++r) {
+        _buffer_q->pushSpill(pileups[0].sample_id, this_children_ref[r], spill_path);
+    }
+}
+
+
+void ParserJob::_beginStreamingRef(const int &ref_idx)
+{
+    // A reference's indel tables are written out when it ends, so each gets its own arena to free them then
+    _streaming_ref = std::make_unique< RefPileup >(makeIndelArena());
+    RefPileup &ref_pileup = *_streaming_ref;
+    long capacity = 1;
+    while(capacity < std::min(ref_lens[ref_idx], STREAMING_WINDOW_POSITIONS)) {
+        capacity <<= 1;
+    }
+    ref_pileup.nucleotide_counts = std::vector< PagedArray< int > >(_iupac_map.size(), PagedArray< int >(capacity));
+    ref_pileup.qual_sums = std::vector< PagedArray< long > >(_iupac_map.size(), PagedArray< long >(capacity));
+    ref_pileup.mapq_sums = std::vector< PagedArray< long > >(_iupac_map.size(), PagedArray< long >(capacity));
+    _window_start = 0;
+    _window_mask = capacity - 1;
+}
+
+
+void ParserJob::_endStreamingRef(const int &ref_idx)
+{
+    RefPileup &ref_pileup = *_streaming_ref;
+    _flushWindow(ref_idx, ref_lens[ref_idx]);
+    _spill_writer->endRef(ref_pileup.insertions, ref_pileup.deletions);
+    if(_cache_writer) {
+        _cache_writer->endRef(ref_pileup.insertions, ref_pileup.deletions);
+    }
+    _streaming_ref.reset();
+}
+
+
+void ParserJob::_advanceWindow(const int &ref_idx, const long &read_start, const long &read_span)
+{
+    if((read_start + read_span) <= (_window_start + _window_mask + 1)) {
+        return;
+    }
+    // Input is sorted, so every position left of this read's start is final
+    _flushWindow(ref_idx, read_start);
+    while((read_start + read_span) > (_window_start + _window_mask + 1)) {
+        _growWindow(ref_idx);
+    }
+}
+
+
+void ParserJob::_flushWindow(const int &ref_idx, const long &stop)
+{
+    RefPileup &ref_pileup = *_streaming_ref;
+    std::vector< PagedArray< int > > &nucl = ref_pileup.nucleotide_counts;
+    std::vector< PagedArray< long > > &qual = ref_pileup.qual_sums;
+    std::vector< PagedArray< long > > &mapq = ref_pileup.mapq_sums;
+
+    // Positions past the window hold no reads; their slots alias positions already flushed (and cleared) here
+    long flush_stop = std::min(stop, std::max(ref_lens[ref_idx], _window_start + _window_mask + 1));
+    int counts[4];
+    long quals[4];
+    long mapqs[4];
+    for(long j = _window_start; j < flush_stop; ++j) {
+        long slot = j & _window_mask;
+        if(j < ref_lens[ref_idx]) {
+            _writePositionalLine(_positional_ofs, ref_pileup, this_children_ref[ref_idx], j, slot);
+            for(int i = 0; i < 4; ++i) {
+                counts[i] = nucl[i][slot];
+                quals[i] = qual[i][slot];
+                mapqs[i] = mapq[i][slot];
             }
-            ofs << std::endl;
+            _spill_writer->appendPosition(counts, quals, mapqs);
+            if(_cache_writer) {
+                _cache_writer->appendPosition(counts, quals, mapqs);
+            }
+        }
+        for(int i = 0; i < 4; ++i) {
+            nucl[i].clear(slot);
+            qual[i].clear(slot);
+            mapq[i].clear(slot);
         }
     }
+    _window_start = std::max(_window_start, stop);
+}
 
-    ofs.close();
+
+void ParserJob::_growWindow(const int &ref_idx)
+{
+    RefPileup &ref_pileup = *_streaming_ref;
+    long new_mask = (2 * (_window_mask + 1)) - 1;
+    regrowRing(ref_pileup.nucleotide_counts, _window_start, _window_mask, new_mask);
+    regrowRing(ref_pileup.qual_sums, _window_start, _window_mask, new_mask);
+    regrowRing(ref_pileup.mapq_sums, _window_start, _window_mask, new_mask);
+    _window_mask = new_mask;
 }
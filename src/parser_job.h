@@ -5,8 +5,15 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <fstream>
+#include <memory>
+#include <chrono>
 #include "concurrent_buffer_queue.h"
 #include "args.h"
+#include "pileup_cache.h"
+#include "pileup_spill.h"
+#include "sam_header.h"
+#include "sam_reader.h"
 
 
 class ParserJob {
@@ -20,37 +27,84 @@ public:
     void printInfo();
     void run();
 
+    static std::string pileupName(const std::string &sam_filepath, const std::string &samplename);
+    static std::string pileupCachePath(const Args &args,
+                                       const std::string &sam_filepath,
+                                       const std::string &samplename);
+    static std::string pileupCacheKey(const std::string &sam_filepath, const Args &args);
+    static std::string pileupOptionsKey(const Args &args);
+
     std::string sam_filepath;
     std::string samplename;
-    std::string sam_readgroup;
-    std::string sam_sampleid;
     std::string reference_name;
     std::string this_parent_ref;
     std::vector< std::string > this_children_ref;
-    std::unordered_map< std::string, std::vector< std::vector< int > > > nucleotide_counts;
-    std::unordered_map< std::string, std::vector< std::vector< long > > > qual_sums;
-    std::unordered_map< std::string, std::vector< std::vector< long > > > mapq_sums;
+    std::vector< long > ref_lens;
 
-    // { ref_name : { 0-idx : { length : < count, ins-qsum, left-qsum, right-qsum > } } }
-    std::unordered_map< std::string, std::unordered_map< long, std::unordered_map< int, std::vector< long > > > > insertions;
+    // One pileup per distinct @RG SM, in header order; reads are credited by their RG:Z: tag
+    std::vector< SamplePileup > pileups;
 
-    // { ref_name : { 0-idx : { length : < count, left-qsum, right-qsum > } } }
-    std::unordered_map< std::string, std::unordered_map< long, std::unordered_map< int, std::vector< long > > > > deletions;
-    std::vector< long > ref_lens;
+    // Alignment lines read, SEQ bases of the reads piled up, and reads not piled up because their start position was
+    // already at the depth cap
+    long num_reads = 0;
+    long num_bases = 0;
+    long depth_skipped_reads = 0;
 
 private:
     Args& _args;
     ConcurrentBufferQueue* _buffer_q;
     std::string _output_dir;
 
-    void _addAlignedRead(const std::string &ref,
+    bool _passesReadFilters(const std::string &sam_line);
+    int _readPileup(const std::string &sam_line);
+    int _readRef(const std::string &ref);
+    // Depth cap (-m): whether a read starting at 1-idx pos is piled up
+    bool _admitRead(const int &pileup_idx, const int &ref_idx, const long &pos);
+    void _addAlignedRead(RefPileup &ref_pileup,
                          const std::string &cigar,
                          const std::string &seq,
                          const std::string &qual,
                          const long &pos,
                          const int &mapq);
-    std::vector< std::string > _parseSamLine(const std::string &sam_line);
-    void _writePositionalData();
+    void _parseSamLine(const std::string &sam_line, std::vector< std::string > &fields);
+    void _pushResults();
+    std::string _positionalDataPath(const int &pileup_idx);
+    void _writePositionalData(const int &pileup_idx);
+    void _writePositionalHeader(std::ofstream &ofs);
+    void _writePositionalLine(std::ofstream &ofs,
+                              const RefPileup &ref_pileup,
+                              const std::string &ref,
+                              const long &pos,
+                              const long &idx);
+
+    // Streaming mode for coordinate-sorted SAM files with out-of-core calling
+    void _runStreaming(SamReader &reader, const std::string &first_line);
+    void _beginStreamingRef(const int &ref_idx);
+    void _endStreamingRef(const int &ref_idx);
+    void _advanceWindow(const int &ref_idx, const long &read_start, const long &read_span);
+    void _flushWindow(const int &ref_idx, const long &stop);
+    void _growWindow(const int &ref_idx);
+
+    // { @RG ID : index in pileups }
+    std::unordered_map< std::string, int > _readgroup_pileups;
+
+    // { @SQ reference : index in this_children_ref }, looked up once per read
+    std::unordered_map< std::string, int > _ref_idxs;
+
+    // In streaming mode the count/sum arrays of the current reference are a ring buffer of _window_mask + 1
+    // (a power of two) positions holding [_window_start, _window_start + _window_mask + 1).  The default mask
+    // of all ones makes slot == position for whole-reference arrays.
+    long _window_start = 0;
+    long _window_mask = -1;
+    // Streaming mode: pileup of the current reference, built with its own arena and freed when the reference ends
+    std::unique_ptr< RefPileup > _streaming_ref;
+    std::ofstream _positional_ofs;
+    std::unique_ptr< PileupSpillWriter > _spill_writer;
+    std::unique_ptr< PileupCacheWriter > _cache_writer;
+
+    // Reader stage of this job's input pipeline; the parser stage is the job's own thread
+    std::unique_ptr< SamReader > _reader;
+    std::chrono::steady_clock::time_point _parse_start;
     const std::unordered_map< char, int > _iupac_map = {
             {'A', 0},
             {'C', 1},
@@ -0,0 +1,353 @@
+#include "pileup_cache.h"
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const char PILEUP_CACHE_MAGIC[8] = {'S', 'S', 'N', 'P', 'P', 'U', '0', '2'};
+
+// Positions buffered by PileupCacheWriter before they are written to the count/sum arrays
+static const long CACHE_CHUNK_POSITIONS = 4096;
+
+
+template <typename T>
+static void writeValue(std::ofstream &ofs, const T &value)
+{
+    ofs.write((const char*)&value, sizeof(T));
+}
+
+
+template <typename T>
+static bool readValue(std::ifstream &ifs, T &value)
+{
+    return (bool)ifs.read((char*)&value, sizeof(T));
+}
+
+
+static void writeString(std::ofstream &ofs, const std::string &s)
+{
+    writeValue(ofs, (uint64_t)s.length());
+    ofs.write(s.data(), s.length());
+}
+
+
+static bool readString(std::ifstream &ifs, std::string &s)
+{
+    uint64_t len;
+    if(!readValue(ifs, len) || (len > (1 << 20))) {
+        return false;
+    }
+    s.resize(len);
+    return (bool)ifs.read(&s[0], len);
+}
+
+
+// Arrays are stored dense; pages that were never written are emitted as zeros
+template <typename T>
+static void writeArrays(std::ofstream &ofs, const std::vector< PagedArray< T > > &arrays)
+{
+    const std::vector< T > zero_page(PagedArray< T >::page_size, T());
+    for(int i = 0; i < arrays.size(); ++i) {
+        for(long p = 0; p < arrays[i].numPages(); ++p) {
+            long page_len = std::min(PagedArray< T >::page_size, arrays[i].size() - (p * PagedArray< T >::page_size));
+            const T* page = arrays[i].page(p);
+            ofs.write((const char*)(page ? page : zero_page.data()), page_len * sizeof(T));
+        }
+    }
+}
+
+
+// Only pages holding a non-zero value are allocated, so a sparse sample stays sparse when loaded
+template <typename T>
+static bool readArrays(std::ifstream &ifs, std::vector< PagedArray< T > > &arrays, const long &len)
+{
+    arrays.assign(4, PagedArray< T >(len));
+    std::vector< T > buffer(PagedArray< T >::page_size);
+    for(int i = 0; i < arrays.size(); ++i) {
+        for(long p = 0; p < arrays[i].numPages(); ++p) {
+            long page_len = std::min(PagedArray< T >::page_size, len - (p * PagedArray< T >::page_size));
+            if(!ifs.read((char*)buffer.data(), page_len * sizeof(T))) {
+                return false;
+            }
+            if(std::any_of(buffer.begin(), buffer.begin() + page_len, [](const T &value) { return value != 0; })) {
+                std::copy(buffer.begin(), buffer.begin() + page_len, arrays[i].touchPage(p));
+            }
+        }
+    }
+    return true;
+}
+
+
+static void writeIndels(std::ofstream &ofs,
+                        const IndelTable &indels)
+{
+    writeValue(ofs, (uint64_t)indels.size());
+    for(auto &[pos, len_map] : indels) {
+        writeValue(ofs, (int64_t)pos);
+        writeValue(ofs, (uint32_t)len_map.size());
+        for(auto &[len, vec] : len_map) {
+            writeValue(ofs, (int32_t)len);
+            writeValue(ofs, (uint32_t)vec.size());
+            ofs.write((const char*)vec.data(), vec.size() * sizeof(long));
+        }
+    }
+}
+
+
+static bool readIndels(std::ifstream &ifs,
+                       IndelTable &indels)
+{
+    uint64_t num_pos;
+    if(!readValue(ifs, num_pos)) {
+        return false;
+    }
+    indels.reserve(num_pos);
+    for(uint64_t p = 0; p < num_pos; ++p) {
+        int64_t pos;
+        uint32_t num_lens;
+        if(!readValue(ifs, pos) || !readValue(ifs, num_lens)) {
+            return false;
+        }
+        IndelLengths &len_map = indels[pos];
+        for(uint32_t l = 0; l < num_lens; ++l) {
+            int32_t len;
+            uint32_t vec_size;
+            if(!readValue(ifs, len) || !readValue(ifs, vec_size) || (vec_size > 16)) {
+                return false;
+            }
+            std::pmr::vector< long > &vec = len_map[len];
+            vec.resize(vec_size);
+            if(!ifs.read((char*)vec.data(), vec_size * sizeof(long))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+PileupCache::PileupCache(const std::string &cache_path, const std::string &key) : cache_path(cache_path), key(key)
+{
+
+}
+
+
+bool PileupCache::load(std::vector< std::string > &refs,
+                       std::vector< long > &ref_lens,
+                       std::vector< SamplePileup > &pileups)
+{
+    std::ifstream ifs(cache_path, std::ios::binary);
+    if(!ifs.is_open()) {
+        return false;
+    }
+
+    char magic[8];
+    std::string file_key;
+    if(!ifs.read(magic, sizeof(magic))) {
+        return false;
+    }
+    if(std::memcmp(magic, PILEUP_CACHE_MAGIC, sizeof(magic)) != 0) {
+        return false;
+    }
+    if(!readString(ifs, file_key) || (file_key != key)) {
+        return false;
+    }
+
+    uint64_t num_samples;
+    if(!readValue(ifs, num_samples) || (num_samples == 0)) {
+        return false;
+    }
+    pileups.clear();
+    pileups.resize(num_samples);
+    for(uint64_t s = 0; s < num_samples; ++s) {
+        SamplePileup &pileup = pileups[s];
+        uint64_t num_refs;
+        if(!readString(ifs, pileup.sample_id) || !readString(ifs, pileup.readgroup) || !readValue(ifs, num_refs)) {
+            return false;
+        }
+        refs.clear();
+        ref_lens.clear();
+        pileup.refs.resize(num_refs);
+        for(uint64_t r = 0; r < num_refs; ++r) {
+            std::string ref;
+            int64_t len;
+            if(!readString(ifs, ref) || !readValue(ifs, len) || (len <= 0)) {
+                return false;
+            }
+            refs.push_back(ref);
+            ref_lens.push_back(len);
+            RefPileup &ref_pileup = pileup.refs[r];
+            if(!readArrays(ifs, ref_pileup.nucleotide_counts, len)
+               || !readArrays(ifs, ref_pileup.qual_sums, len)
+               || !readArrays(ifs, ref_pileup.mapq_sums, len)
+               || !readIndels(ifs, ref_pileup.insertions)
+               || !readIndels(ifs, ref_pileup.deletions)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+bool PileupCache::save(const std::vector< std::string > &refs,
+                       const std::vector< long > &ref_lens,
+                       const std::vector< SamplePileup > &pileups)
+{
+    // Written to a temporary file and renamed so an interrupted run never leaves a truncated cache behind
+    std::string tmp_path = cache_path + ".tmp." + std::to_string(getpid());
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    if(!ofs.is_open()) {
+        return false;
+    }
+
+    ofs.write(PILEUP_CACHE_MAGIC, sizeof(PILEUP_CACHE_MAGIC));
+    writeString(ofs, key);
+    writeValue(ofs, (uint64_t)pileups.size());
+    for(const SamplePileup &pileup : pileups) {
+        writeString(ofs, pileup.sample_id);
+        writeString(ofs, pileup.readgroup);
+        writeValue(ofs, (uint64_t)refs.size());
+        for(int r = 0; r < refs.size(); ++r) {
+            writeString(ofs, refs[r]);
+            writeValue(ofs, (int64_t)ref_lens[r]);
+            writeArrays(ofs, pileup.refs[r].nucleotide_counts);
+            writeArrays(ofs, pileup.refs[r].qual_sums);
+            writeArrays(ofs, pileup.refs[r].mapq_sums);
+            writeIndels(ofs, pileup.refs[r].insertions);
+            writeIndels(ofs, pileup.refs[r].deletions);
+        }
+    }
+    ofs.close();
+
+    if(ofs.fail() || (std::rename(tmp_path.c_str(), cache_path.c_str()) != 0)) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+std::string PileupCache::fileKey(const std::string &filepath)
+{
+    struct stat sb;
+    if(stat(filepath.c_str(), &sb) != 0) {
+        return filepath;
+    }
+    long mtime = ((long)sb.st_mtim.tv_sec * 1000000000) + (long)sb.st_mtim.tv_nsec;
+    return filepath + '|' + std::to_string((long)sb.st_size) + '|' + std::to_string(mtime);
+}
+
+
+PileupCacheWriter::PileupCacheWriter(const std::string &cache_path,
+                                     const std::string &key,
+                                     const std::string &sample_id,
+                                     const std::string &readgroup,
+                                     const std::vector< std::string > &refs,
+                                     const std::vector< long > &ref_lens)
+                                     : _cache_path(cache_path),
+                                     _tmp_path(cache_path + ".tmp." + std::to_string(getpid())),
+                                     _refs(refs),
+                                     _ref_lens(ref_lens)
+{
+    _ofs.open(_tmp_path, std::ios::binary);
+    _ofs.write(PILEUP_CACHE_MAGIC, sizeof(PILEUP_CACHE_MAGIC));
+    writeString(_ofs, key);
+    writeValue(_ofs, (uint64_t)1);
+    writeString(_ofs, sample_id);
+    writeString(_ofs, readgroup);
+    writeValue(_ofs, (uint64_t)refs.size());
+    _chunk_counts.assign(4, std::vector< int >());
+    _chunk_qual_sums.assign(4, std::vector< long >());
+    _chunk_mapq_sums.assign(4, std::vector< long >());
+    if(!_refs.empty()) {
+        _beginRef();
+    }
+}
+
+
+void PileupCacheWriter::appendPosition(const int counts[4], const long qual_sums[4], const long mapq_sums[4])
+{
+    for(int i = 0; i < 4; ++i) {
+        _chunk_counts[i].push_back(counts[i]);
+        _chunk_qual_sums[i].push_back(qual_sums[i]);
+        _chunk_mapq_sums[i].push_back(mapq_sums[i]);
+    }
+    _position++;
+    if(_chunk_counts[0].size() == CACHE_CHUNK_POSITIONS) {
+        _flushChunk();
+    }
+}
+
+
+void PileupCacheWriter::endRef(const IndelTable &insertions,
+                               const IndelTable &deletions)
+{
+    const int zero_counts[4] = {0, 0, 0, 0};
+    const long zero_sums[4] = {0, 0, 0, 0};
+    while(_position < _ref_lens[_ref_idx]) {
+        appendPosition(zero_counts, zero_sums, zero_sums);
+    }
+    _flushChunk();
+
+    long len = _ref_lens[_ref_idx];
+    _ofs.seekp(_arrays_offset + (4 * len * (std::streamoff)(sizeof(int) + sizeof(long) + sizeof(long))));
+    writeIndels(_ofs, insertions);
+    writeIndels(_ofs, deletions);
+
+    _ref_idx++;
+    if(_ref_idx < _refs.size()) {
+        _beginRef();
+    }
+}
+
+
+bool PileupCacheWriter::close()
+{
+    bool complete = (_ref_idx == _refs.size());
+    _ofs.close();
+
+    if(!complete || _ofs.fail() || (std::rename(_tmp_path.c_str(), _cache_path.c_str()) != 0)) {
+        std::remove(_tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+void PileupCacheWriter::_beginRef()
+{
+    writeString(_ofs, _refs[_ref_idx]);
+    writeValue(_ofs, (int64_t)_ref_lens[_ref_idx]);
+    _arrays_offset = _ofs.tellp();
+    _position = 0;
+    _chunk_start = 0;
+}
+
+
+void PileupCacheWriter::_flushChunk()
+{
+    // Array layout per reference: 4 count arrays, then 4 quality sum arrays, then 4 mapq sum arrays
+    long len = _ref_lens[_ref_idx];
+    for(int i = 0; i < 4; ++i) {
+        _ofs.seekp(_arrays_offset + (((i * len) + _chunk_start) * (std::streamoff)sizeof(int)));
+        _ofs.write((const char*)_chunk_counts[i].data(), _chunk_counts[i].size() * sizeof(int));
+    }
+    std::streamoff qual_offset = _arrays_offset + (4 * len * (std::streamoff)sizeof(int));
+    for(int i = 0; i < 4; ++i) {
+        _ofs.seekp(qual_offset + (((i * len) + _chunk_start) * (std::streamoff)sizeof(long)));
+        _ofs.write((const char*)_chunk_qual_sums[i].data(), _chunk_qual_sums[i].size() * sizeof(long));
+    }
+    std::streamoff mapq_offset = qual_offset + (4 * len * (std::streamoff)sizeof(long));
+    for(int i = 0; i < 4; ++i) {
+        _ofs.seekp(mapq_offset + (((i * len) + _chunk_start) * (std::streamoff)sizeof(long)));
+        _ofs.write((const char*)_chunk_mapq_sums[i].data(), _chunk_mapq_sums[i].size() * sizeof(long));
+        _chunk_counts[i].clear();
+        _chunk_qual_sums[i].clear();
+        _chunk_mapq_sums[i].clear();
+    }
+    _chunk_start = _position;
+}
@@ -0,0 +1,70 @@
+#ifndef SIMPLE_SNP_PILEUP_CACHE_H
+#define SIMPLE_SNP_PILEUP_CACHE_H
+
+#include <string>
+#include <vector>
+#include "paged_array.h"
+#include "sample_pileup.h"
+#include <fstream>
+#include <unordered_map>
+
+
+// Binary snapshot of one ParserJob's pileups (counts, quality/mapq sums and indel tables for every reference of
+// every sample in the SAM file).
+// The file starts with the cache key it was built for; load() refuses a file whose key differs, so a changed SAM,
+// reference or parse option simply causes a reparse and overwrite.
+class PileupCache {
+public:
+    PileupCache(const std::string &cache_path, const std::string &key);
+
+    bool load(std::vector< std::string > &refs,
+              std::vector< long > &ref_lens,
+              std::vector< SamplePileup > &pileups);
+    bool save(const std::vector< std::string > &refs,
+              const std::vector< long > &ref_lens,
+              const std::vector< SamplePileup > &pileups);
+
+    static std::string fileKey(const std::string &filepath);
+
+    std::string cache_path;
+    std::string key;
+};
+
+
+// Streaming counterpart of PileupCache::save() for coordinate-sorted input of a single sample.  References are
+// written in the given order; positions are appended as they become final (each chunk lands in its place in the four count/sum arrays)
+// and the indel tables are written when the reference ends.  close() renames the finished file into place.
+class PileupCacheWriter {
+public:
+    PileupCacheWriter(const std::string &cache_path,
+                      const std::string &key,
+                      const std::string &sample_id,
+                      const std::string &readgroup,
+                      const std::vector< std::string > &refs,
+                      const std::vector< long > &ref_lens);
+
+    void appendPosition(const int counts[4], const long qual_sums[4], const long mapq_sums[4]);
+    void endRef(const IndelTable &insertions,
+                const IndelTable &deletions);
+    bool close();
+
+private:
+    void _beginRef();
+    void _flushChunk();
+
+    std::string _cache_path;
+    std::string _tmp_path;
+    std::ofstream _ofs;
+    std::vector< std::string > _refs;
+    std::vector< long > _ref_lens;
+    int _ref_idx = 0;
+    long _position = 0;
+    long _chunk_start = 0;
+    std::streamoff _arrays_offset = 0;
+    std::vector< std::vector< int > > _chunk_counts;
+    std::vector< std::vector< long > > _chunk_qual_sums;
+    std::vector< std::vector< long > > _chunk_mapq_sums;
+};
+
+
+#endif //SIMPLE_SNP_PILEUP_CACHE_H
@@ -0,0 +1,348 @@
+#include "pileup_spill.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+
+
+static const char PILEUP_SPILL_MAGIC[8] = {'S', 'S', 'N', 'P', 'S', 'P', '0', '1'};
+
+// Positions are read and written in chunks of this many records
+static const long SPILL_CHUNK_RECORDS = 4096;
+
+
+// Counts and sums for one position, in pileup allele order <A, C, G, T>
+struct SpillRecord {
+    int32_t counts[4];
+    int64_t qual_sums[4];
+    int64_t mapq_sums[4];
+};
+
+
+// One (position, length) entry of an insertion or deletion table
+struct SpillIndelRecord {
+    int64_t pos;
+    int32_t len;
+    uint32_t num_values;
+    int64_t values[4];
+};
+
+
+template <typename T>
+static void writeValue(std::ofstream &ofs, const T &value)
+{
+    ofs.write((const char*)&value, sizeof(T));
+}
+
+
+template <typename T>
+static bool readValue(std::ifstream &ifs, T &value)
+{
+    return (bool)ifs.read((char*)&value, sizeof(T));
+}
+
+
+static void writeString(std::ofstream &ofs, const std::string &s)
+{
+    writeValue(ofs, (uint64_t)s.length());
+    ofs.write(s.data(), s.length());
+}
+
+
+static bool readString(std::ifstream &ifs, std::string &s)
+{
+    uint64_t len;
+    if(!readValue(ifs, len) || (len > (1 << 20))) {
+        return false;
+    }
+    s.resize(len);
+    return (bool)ifs.read(&s[0], len);
+}
+
+
+static uint64_t writeIndels(std::ofstream &ofs,
+                            const IndelTable &indels)
+{
+    std::vector< SpillIndelRecord > records;
+    for(auto &[pos, len_map] : indels) {
+        for(auto &[len, vec] : len_map) {
+            SpillIndelRecord record;
+            std::memset(&record, 0, sizeof(record));
+            record.pos = pos;
+            record.len = len;
+            record.num_values = std::min(vec.size(), (std::size_t)4);
+            std::copy(vec.begin(), vec.begin() + record.num_values, record.values);
+            records.push_back(record);
+        }
+    }
+    std::sort(records.begin(), records.end(), [](const SpillIndelRecord &a, const SpillIndelRecord &b) {
+        return (a.pos < b.pos) || ((a.pos == b.pos) && (a.len < b.len));
+    });
+    ofs.write((const char*)records.data(), records.size() * sizeof(SpillIndelRecord));
+    return records.size();
+}
+
+
+bool PileupSpill::write(const std::string &spill_path,
+                        const std::string &sample_id,
+                        const std::vector< std::string > &refs,
+                        const std::vector< long > &ref_lens,
+                        const std::vector< RefPileup > &ref_pileups)
+{
+    PileupSpillWriter writer(spill_path, sample_id, refs, ref_lens);
+    int counts[4];
+    long quals[4];
+    long mapqs[4];
+    for(int r = 0; r < refs.size(); ++r) {
+        const std::vector< PagedArray< int > > &nucl = ref_pileups[r].nucleotide_counts;
+        const std::vector< PagedArray< long > > &qual = ref_pileups[r].qual_sums;
+        const std::vector< PagedArray< long > > &mapq = ref_pileups[r].mapq_sums;
+        for(long j = 0; j < ref_lens[r]; ++j) {
+            for(int i = 0; i < 4; ++i) {
+                counts[i] = nucl[i][j];
+                quals[i] = qual[i][j];
+                mapqs[i] = mapq[i][j];
+            }
+            writer.appendPosition(counts, quals, mapqs);
+        }
+        writer.endRef(ref_pileups[r].insertions, ref_pileups[r].deletions);
+    }
+    return writer.close();
+}
+
+
+PileupSpillWriter::PileupSpillWriter(const std::string &spill_path,
+                                     const std::string &sample_id,
+                                     const std::vector< std::string > &refs,
+                                     const std::vector< long > &ref_lens)
+                                     : _spill_path(spill_path),
+                                     _tmp_path(spill_path + ".tmp." + std::to_string(getpid())),
+                                     _ref_lens(ref_lens)
+{
+    _ofs.open(_tmp_path, std::ios::binary);
+    _ofs.write(PILEUP_SPILL_MAGIC, sizeof(PILEUP_SPILL_MAGIC));
+    writeString(_ofs, sample_id);
+    writeValue(_ofs, (uint64_t)refs.size());
+    std::vector< uint64_t > placeholder(5, 0);
+    for(int r = 0; r < refs.size(); ++r) {
+        writeString(_ofs, refs[r]);
+        writeValue(_ofs, (int64_t)ref_lens[r]);
+        _field_offsets.push_back(_ofs.tellp());
+        _ofs.write((const char*)placeholder.data(), placeholder.size() * sizeof(uint64_t));
+    }
+    _records_offset = _ofs.tellp();
+    _records.reserve(SPILL_CHUNK_RECORDS * sizeof(SpillRecord));
+}
+
+
+void PileupSpillWriter::appendPosition(const int counts[4], const long qual_sums[4], const long mapq_sums[4])
+{
+    SpillRecord record;
+    for(int i = 0; i < 4; ++i) {
+        record.counts[i] = counts[i];
+        record.qual_sums[i] = qual_sums[i];
+        record.mapq_sums[i] = mapq_sums[i];
+    }
+    _records.insert(_records.end(), (const char*)&record, (const char*)&record + sizeof(record));
+    _position++;
+    if(_records.size() == (SPILL_CHUNK_RECORDS * sizeof(SpillRecord))) {
+        _flushRecords();
+    }
+}
+
+
+void PileupSpillWriter::endRef(const IndelTable &insertions,
+                               const IndelTable &deletions)
+{
+    const int zero_counts[4] = {0, 0, 0, 0};
+    const long zero_sums[4] = {0, 0, 0, 0};
+    while(_position < _ref_lens[_ref_idx]) {
+        appendPosition(zero_counts, zero_sums, zero_sums);
+    }
+    _flushRecords();
+
+    uint64_t insertions_offset = _ofs.tellp();
+    uint64_t num_insertions = writeIndels(_ofs, insertions);
+    uint64_t deletions_offset = _ofs.tellp();
+    uint64_t num_deletions = writeIndels(_ofs, deletions);
+    _section_fields.push_back({_records_offset, num_insertions, insertions_offset, num_deletions, deletions_offset});
+
+    _records_offset = _ofs.tellp();
+    _position = 0;
+    _ref_idx++;
+}
+
+
+bool PileupSpillWriter::close()
+{
+    for(int r = 0; r < _section_fields.size(); ++r) {
+        _ofs.seekp(_field_offsets[r]);
+        _ofs.write((const char*)_section_fields[r].data(), _section_fields[r].size() * sizeof(uint64_t));
+    }
+    bool complete = (_section_fields.size() == _ref_lens.size());
+    _ofs.close();
+
+    if(!complete || _ofs.fail() || (std::rename(_tmp_path.c_str(), _spill_path.c_str()) != 0)) {
+        std::remove(_tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+void PileupSpillWriter::_flushRecords()
+{
+    _ofs.write(_records.data(), _records.size());
+    _records.clear();
+}
+
+
+PileupSpillReader::PileupSpillReader(const std::string &spill_path) : spill_path(spill_path)
+{
+    _ifs.open(spill_path, std::ios::binary);
+    char magic[8];
+    uint64_t num_refs = 0;
+    bool valid = _ifs.is_open()
+                 && _ifs.read(magic, sizeof(magic))
+                 && (std::memcmp(magic, PILEUP_SPILL_MAGIC, sizeof(magic)) == 0)
+                 && readString(_ifs, sample_id)
+                 && readValue(_ifs, num_refs);
+    for(uint64_t r = 0; valid && (r < num_refs); ++r) {
+        std::string ref;
+        int64_t len;
+        RefSection section;
+        valid = readString(_ifs, ref)
+                && readValue(_ifs, len)
+                && readValue(_ifs, section.records_offset)
+                && readValue(_ifs, section.num_insertions)
+                && readValue(_ifs, section.insertions_offset)
+                && readValue(_ifs, section.num_deletions)
+                && readValue(_ifs, section.deletions_offset);
+        section.len = len;
+        refs.push_back(ref);
+        _sections[ref] = section;
+    }
+    if(!valid) {
+        std::cerr << "ERROR: Pileup spill file is missing or corrupt: " << spill_path << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+
+void PileupSpillReader::readBlock(const std::string &ref, const long &start, const long &stop, PileupBlock &block)
+{
+    long block_len = stop - start;
+    block.start = start;
+    block.stop = stop;
+    block.nucleotide_counts.assign(4, PagedArray< int >(block_len));
+    block.qual_sums.assign(4, PagedArray< long >(block_len));
+    block.mapq_sums.assign(4, PagedArray< long >(block_len));
+    block.insertions.clear();
+    block.deletions.clear();
+
+    auto found = _sections.find(ref);
+    if(found == _sections.end()) {
+        return;
+    }
+    const RefSection &section = found->second;
+
+    long read_stop = std::min(stop, section.len);
+    if(start < read_stop) {
+        std::vector< SpillRecord > records(read_stop - start);
+        _ifs.clear();
+        _ifs.seekg(section.records_offset + (start * sizeof(SpillRecord)));
+        if(!_ifs.read((char*)records.data(), records.size() * sizeof(SpillRecord))) {
+            std::cerr << "ERROR: Truncated pileup spill file: " << spill_path << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        for(long j = 0; j < records.size(); ++j) {
+            // Alleles without reads stay unallocated
+            for(int i = 0; i < 4; ++i) {
+                if(records[j].counts[i] != 0) {
+                    block.nucleotide_counts[i].touch(j) = records[j].counts[i];
+                    block.qual_sums[i].touch(j) = records[j].qual_sums[i];
+                    block.mapq_sums[i].touch(j) = records[j].mapq_sums[i];
+                }
+            }
+        }
+    }
+
+    // Indel records are consumed in position order; only a jump backwards or to another reference rewinds them
+    if((ref != _cursor_ref) || (start < _cursor_stop)) {
+        _cursor_ref = ref;
+        _next_insertion = 0;
+        _next_deletion = 0;
+    }
+    _cursor_stop = stop;
+    _readIndels(section.insertions_offset, section.num_insertions, _next_insertion, start, stop, block.insertions);
+    _readIndels(section.deletions_offset, section.num_deletions, _next_deletion, start, stop, block.deletions);
+}
+
+
+void PileupSpillReader::readDepths(const std::string &ref, PagedArray< int > &depths)
+{
+    auto found = _sections.find(ref);
+    if(found == _sections.end()) {
+        depths = PagedArray< int >();
+        return;
+    }
+    const RefSection &section = found->second;
+    depths = PagedArray< int >(section.len);
+
+    std::vector< SpillRecord > records;
+    _ifs.clear();
+    _ifs.seekg(section.records_offset);
+    for(long chunk_start = 0; chunk_start < section.len; chunk_start += SPILL_CHUNK_RECORDS) {
+        records.resize(std::min(section.len - chunk_start, SPILL_CHUNK_RECORDS));
+        if(!_ifs.read((char*)records.data(), records.size() * sizeof(SpillRecord))) {
+            std::cerr << "ERROR: Truncated pileup spill file: " << spill_path << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        for(long j = 0; j < records.size(); ++j) {
+            int depth = records[j].counts[0] + records[j].counts[1] + records[j].counts[2] + records[j].counts[3];
+            if(depth != 0) {
+                depths.touch(chunk_start + j) = depth;
+            }
+        }
+    }
+}
+
+
+long PileupSpillReader::refLength(const std::string &ref) const
+{
+    auto found = _sections.find(ref);
+    if(found == _sections.end()) {
+        return 0;
+    }
+    return found->second.len;
+}
+
+
+void PileupSpillReader::_readIndels(const uint64_t &section_offset,
+                                    const uint64_t &num_records,
+                                    uint64_t &next_record,
+                                    const long &start,
+                                    const long &stop,
+                                    IndelTable &indels)
+{
+    if(next_record >= num_records) {
+        return;
+    }
+    _ifs.clear();
+    _ifs.seekg(section_offset + (next_record * sizeof(SpillIndelRecord)));
+    SpillIndelRecord record;
+    while(next_record < num_records) {
+        if(!_ifs.read((char*)&record, sizeof(record)) || (record.num_values > 4)) {
+            std::cerr << "ERROR: Truncated pileup spill file: " << spill_path << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        if(record.pos >= stop) {
+            break;
+        }
+        if(record.pos >= start) {
+            indels[record.pos][record.len].assign(record.values, record.values + record.num_values);
+        }
+        next_record++;
+    }
+}
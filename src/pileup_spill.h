@@ -0,0 +1,116 @@
+#ifndef SIMPLE_SNP_PILEUP_SPILL_H
+#define SIMPLE_SNP_PILEUP_SPILL_H
+
+#include <string>
+#include <vector>
+#include "paged_array.h"
+#include "sample_pileup.h"
+#include <fstream>
+#include <cstdint>
+#include <unordered_map>
+
+
+// One block of positions [start, stop) of a single sample and reference, in the same shape the in-memory pileup
+// uses: 4 x (stop - start) count/sum arrays indexed from start, and indel tables keyed by absolute position.
+struct PileupBlock {
+    long start = 0;
+    long stop = 0;
+    std::vector< PagedArray< int > > nucleotide_counts;
+    std::vector< PagedArray< long > > qual_sums;
+    std::vector< PagedArray< long > > mapq_sums;
+    IndelTable insertions;
+    IndelTable deletions;
+};
+
+
+// Position-sorted on-disk pileup of one sample for out-of-core calling.  Each reference is stored as one
+// fixed-size record per position followed by its insertion and deletion records sorted by position, so a block of
+// positions is read with one seek per section and the indel sections are streamed forward block by block.
+class PileupSpill {
+public:
+    // ref_pileups is parallel to refs
+    static bool write(const std::string &spill_path,
+                      const std::string &sample_id,
+                      const std::vector< std::string > &refs,
+                      const std::vector< long > &ref_lens,
+                      const std::vector< RefPileup > &ref_pileups);
+};
+
+
+// Streaming writer for one spill file.  References are written in the given order: positions are appended as they
+// become final (a reference is padded with zero depth when it is ended early) and its indel tables are written
+// when it ends.  The section offsets in the header are filled in by close(), which renames the finished file into
+// place.
+class PileupSpillWriter {
+public:
+    PileupSpillWriter(const std::string &spill_path,
+                      const std::string &sample_id,
+                      const std::vector< std::string > &refs,
+                      const std::vector< long > &ref_lens);
+
+    void appendPosition(const int counts[4], const long qual_sums[4], const long mapq_sums[4]);
+    void endRef(const IndelTable &insertions,
+                const IndelTable &deletions);
+    bool close();
+
+private:
+    void _flushRecords();
+
+    std::string _spill_path;
+    std::string _tmp_path;
+    std::ofstream _ofs;
+    std::vector< long > _ref_lens;
+    // Header position of each reference's section fields, and their values once the reference has ended
+    std::vector< uint64_t > _field_offsets;
+    std::vector< std::vector< uint64_t > > _section_fields;
+    int _ref_idx = 0;
+    long _position = 0;
+    uint64_t _records_offset = 0;
+    std::vector< char > _records;
+};
+
+
+class PileupSpillReader {
+public:
+    PileupSpillReader(const std::string &spill_path);
+
+    // Fill block with positions [start, stop) of ref; positions past the end of the reference (or a reference the
+    // sample has no reads for) read as zero.  Sequential blocks of one reference stream the indel records forward.
+    void readBlock(const std::string &ref, const long &start, const long &stop, PileupBlock &block);
+
+    // Per-position total depth over the whole reference, read block by block
+    void readDepths(const std::string &ref, PagedArray< int > &depths);
+
+    long refLength(const std::string &ref) const;
+
+    std::string spill_path;
+    std::string sample_id;
+    std::vector< std::string > refs;
+
+private:
+    struct RefSection {
+        long len;
+        uint64_t records_offset;
+        uint64_t num_insertions;
+        uint64_t insertions_offset;
+        uint64_t num_deletions;
+        uint64_t deletions_offset;
+    };
+
+    void _readIndels(const uint64_t &section_offset,
+                     const uint64_t &num_records,
+                     uint64_t &next_record,
+                     const long &start,
+                     const long &stop,
+                     IndelTable &indels);
+
+    std::ifstream _ifs;
+    std::unordered_map< std::string, RefSection > _sections;
+    std::string _cursor_ref;
+    long _cursor_stop = 0;
+    uint64_t _next_insertion = 0;
+    uint64_t _next_deletion = 0;
+};
+
+
+#endif //SIMPLE_SNP_PILEUP_SPILL_H
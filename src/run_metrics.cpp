@@ -0,0 +1,129 @@
+#include "run_metrics.h"
+#include "task_trace.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+
+static const char* STAGE_NAMES[RunMetrics::num_stages] = {
+        "header_parse",
+        "read_parse",
+        "positional_write",
+        "pileup_push",
+        "pileup_ingest",
+        "fasta_load",
+        "large_indel_scan",
+        "calling_wait",
+        "variant_calling",
+        "vcf_write"
+};
+
+
+// Items per second, 0 for a stage that never ran
+static double rate(const long &count, const double &seconds)
+{
+    return (seconds > 0) ? (count / seconds) : 0;
+}
+
+
+RunMetrics::RunMetrics()
+{
+    for(int i = 0; i < num_stages; ++i) {
+        _stage_ns[i] = 0;
+        _stage_calls[i] = 0;
+    }
+}
+
+
+void RunMetrics::addTime(const Stage &stage, const long &ns)
+{
+    _stage_ns[stage].fetch_add(ns, std::memory_order_relaxed);
+    _stage_calls[stage].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+double RunMetrics::seconds(const Stage &stage) const
+{
+    return _stage_ns[stage] / 1e9;
+}
+
+
+void RunMetrics::write(const std::string &json_path, const double &wall_seconds, const int &threads) const
+{
+    std::ofstream ofs(json_path);
+    if(!ofs.is_open()) {
+        std::cerr << "WARNING: Could not write run metrics: " << json_path << std::endl;
+        return;
+    }
+    // Stage times are thread-seconds, so throughput per stage second is the rate of one thread in that stage
+    double parse_seconds = seconds(read_parse);
+    double calling_seconds = seconds(variant_calling);
+    ofs << std::fixed << std::setprecision(6);
+    ofs << "{" << std::endl;
+    ofs << "  \"wall_seconds\": " << wall_seconds << "," << std::endl;
+    ofs << "  \"threads\": " << threads << "," << std::endl;
+    ofs << "  \"stages\": {" << std::endl;
+    for(int i = 0; i < num_stages; ++i) {
+        ofs << "    \"" << STAGE_NAMES[i] << "\": {\"seconds\": " << (_stage_ns[i] / 1e9);
+        ofs << ", \"calls\": " << _stage_calls[i] << "}" << ((i + 1 < num_stages) ? "," : "") << std::endl;
+    }
+    ofs << "  }," << std::endl;
+    ofs << "  \"counters\": {" << std::endl;
+    ofs << "    \"sam_files\": " << num_sam_files << "," << std::endl;
+    ofs << "    \"reads\": " << num_reads << "," << std::endl;
+    ofs << "    \"bases\": " << num_bases << "," << std::endl;
+    ofs << "    \"depth_skipped_reads\": " << num_depth_skipped_reads << "," << std::endl;
+    ofs << "    \"positions_called\": " << num_positions << "," << std::endl;
+    ofs << "    \"variant_sites\": " << num_variant_sites << "," << std::endl;
+    ofs << "    \"bytes_written\": " << bytes_written << std::endl;
+    ofs << "  }," << std::endl;
+    ofs << "  \"throughput\": {" << std::endl;
+    ofs << "    \"reads_per_second\": " << rate(num_reads, wall_seconds) << "," << std::endl;
+    ofs << "    \"bases_per_second\": " << rate(num_bases, wall_seconds) << "," << std::endl;
+    ofs << "    \"positions_per_second\": " << rate(num_positions, wall_seconds) << "," << std::endl;
+    ofs << "    \"bytes_written_per_second\": " << rate(bytes_written, wall_seconds) << "," << std::endl;
+    ofs << "    \"reads_per_parse_second\": " << rate(num_reads, parse_seconds) << "," << std::endl;
+    ofs << "    \"bases_per_parse_second\": " << rate(num_bases, parse_seconds) << "," << std::endl;
+    ofs << "    \"positions_per_calling_second\": " << rate(num_positions, calling_seconds) << std::endl;
+    ofs << "  }," << std::endl;
+    ofs << "  \"input_pipeline\": {" << std::endl;
+    ofs << "    \"sam_files\": " << num_input_pipelines << "," << std::endl;
+    ofs << "    \"reader_busy_seconds\": " << (input_read_ns / 1e9) << "," << std::endl;
+    ofs << "    \"reader_stall_seconds\": " << (input_read_stall_ns / 1e9) << "," << std::endl;
+    ofs << "    \"parser_busy_seconds\": " << (input_parse_ns / 1e9) << "," << std::endl;
+    ofs << "    \"parser_stall_seconds\": " << (input_parse_stall_ns / 1e9) << std::endl;
+    ofs << "  }" << std::endl;
+    ofs << "}" << std::endl;
+}
+
+
+StageTimer::StageTimer(RunMetrics &metrics, const RunMetrics::Stage &stage)
+                       : _metrics(metrics), _stage(stage), _start(std::chrono::steady_clock::now())
+{
+    TaskTrace::begin(STAGE_NAMES[_stage]);
+}
+
+
+StageTimer::~StageTimer()
+{
+    stop();
+}
+
+
+long StageTimer::elapsedNs() const
+{
+    return std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - _start).count();
+}
+
+
+long StageTimer::stop(const long &excluded_ns)
+{
+    if(_stopped) {
+        return 0;
+    }
+    _stopped = true;
+    TaskTrace::end(STAGE_NAMES[_stage]);
+    long ns = elapsedNs() - excluded_ns;
+    _metrics.addTime(_stage, ns);
+    return ns;
+}
@@ -0,0 +1,90 @@
+#ifndef SIMPLE_SNP_RUN_METRICS_H
+#define SIMPLE_SNP_RUN_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+
+// Where a run spends its time and how much it processed, summed over threads and written to
+// <output_dir>/run_metrics.json when the run ends.  Stages are timed around whole jobs, references and files (VCF
+// writing once per variant site), and counters are added once per job or caller, so the per-read and per-position
+// loops are not instrumented.
+class RunMetrics {
+public:
+    enum Stage {
+        header_parse,       // SAM header read and validation
+        read_parse,         // Alignment lines to pileups, excluding waits on the reader stage (streaming mode:
+                            // including the window flushes to spill and positional files)
+        positional_write,   // <sample>_positional_data.tsv of whole-reference pileups
+        pileup_push,        // Publishing a job's pileups to the buffer queue, spill files included
+        pileup_ingest,      // Buffer queue consumer inserting published pileups into its tables
+        fasta_load,         // FASTA index and contig selection
+        large_indel_scan,
+        calling_wait,       // Callers waiting on references still being parsed
+        variant_calling,    // Calling passes over each position, excluding VCF writing
+        vcf_write,
+        num_stages
+    };
+
+    RunMetrics();
+
+    void addTime(const Stage &stage, const long &ns);
+    double seconds(const Stage &stage) const;
+
+    // Writes every stage and counter with throughput derived from them; wall_seconds is the whole run
+    void write(const std::string &json_path, const double &wall_seconds, const int &threads) const;
+
+    // Alignment lines read, and SEQ bases of the reads that were piled up
+    std::atomic< long > num_reads = ATOMIC_VAR_INIT(0);
+    std::atomic< long > num_bases = ATOMIC_VAR_INIT(0);
+    std::atomic< long > num_depth_skipped_reads = ATOMIC_VAR_INIT(0);
+    std::atomic< int > num_sam_files = ATOMIC_VAR_INIT(0);
+
+    // Reference positions visited by the callers, and those written as variant sites
+    std::atomic< long > num_positions = ATOMIC_VAR_INIT(0);
+    std::atomic< long > num_variant_sites = ATOMIC_VAR_INIT(0);
+
+    // Bytes of the TSV, VCF and CSV outputs in output_dir (spill and cache files excluded)
+    std::atomic< long > bytes_written = ATOMIC_VAR_INIT(0);
+
+    // Input pipeline stage times (ns) summed over parser jobs: reader busy/stalled on a full ring, parser
+    // busy/stalled on an empty ring
+    std::atomic< int > num_input_pipelines = ATOMIC_VAR_INIT(0);
+    std::atomic< long > input_read_ns = ATOMIC_VAR_INIT(0);
+    std::atomic< long > input_read_stall_ns = ATOMIC_VAR_INIT(0);
+    std::atomic< long > input_parse_ns = ATOMIC_VAR_INIT(0);
+    std::atomic< long > input_parse_stall_ns = ATOMIC_VAR_INIT(0);
+
+    RunMetrics(const RunMetrics& rhs) = delete;
+    RunMetrics& operator=(const RunMetrics& rhs) = delete;
+
+private:
+    std::atomic< long > _stage_ns[num_stages];
+    std::atomic< long > _stage_calls[num_stages];
+};
+
+
+// Adds the time from construction to destruction (or to stop()) to one stage, and marks the interval on the task
+// trace when tracing is enabled
+class StageTimer {
+public:
+    StageTimer(RunMetrics &metrics, const RunMetrics::Stage &stage);
+    ~StageTimer();
+
+    // Nanoseconds since construction
+    long elapsedNs() const;
+
+    // Record now instead of at destruction, less excluded_ns spent on something timed separately; returns the
+    // nanoseconds recorded (0 if already stopped)
+    long stop(const long &excluded_ns = 0);
+
+private:
+    RunMetrics& _metrics;
+    RunMetrics::Stage _stage;
+    std::chrono::steady_clock::time_point _start;
+    bool _stopped = false;
+};
+
+
+#endif //SIMPLE_SNP_RUN_METRICS_H
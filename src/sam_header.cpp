@@ -0,0 +1,233 @@
+#include "sam_header.h"
+#include "dispatch_queue.h"
+#include <iostream>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+
+
+SamHeader::SamHeader(const std::string &sam_filepath) : sam_filepath(sam_filepath)
+{
+
+}
+
+
+bool SamHeader::read(SamReader &reader, std::string &line)
+{
+    while(reader.getline(line)) {
+        if(line.empty()) {
+            break;
+        }
+        if(line.at(0) != '@') {
+            has_alignments = true;
+            return true;
+        }
+
+        // { two-letter tag : value } of this header line
+        std::unordered_map< std::string, std::string > tags;
+        std::stringstream ss;
+        std::string record_type, part;
+        ss.str(line);
+        std::getline(ss, record_type, '\t');
+        while(std::getline(ss, part, '\t')) {
+            if((part.length() >= 3) && (part.at(2) == ':')) {
+                tags[part.substr(0, 2)] = part.substr(3);
+            }
+        }
+
+        if(record_type == "@HD") {
+            coordinate_sorted = (tags["SO"] == "coordinate");
+        }
+        else if(record_type == "@SQ") {
+            refs.push_back(tags["SN"]);
+            ref_lens.push_back(std::strtol(tags["LN"].c_str(), nullptr, 10));
+        }
+        else if(record_type == "@RG") {
+            readgroups.push_back(tags["ID"]);
+            readgroup_samples.push_back(tags["SM"]);
+        }
+    }
+    line = "";
+    has_alignments = false;
+    return false;
+}
+
+
+void SamHeader::validate(const Args &args)
+{
+    parent_ref = "";
+    for(const std::string &reference_name : refs) {
+        if(!args.db_names_file.empty()) {
+            if(!args.db_index.hasParent(reference_name)) {
+                std::cerr << "ERROR: <reference_db>.names file present, but this reference was not detected ";
+                std::cerr << "in the <reference_db>.names file, provided: " << reference_name << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            if(!parent_ref.empty()) {
+                if(args.db_index.parentOf(reference_name) != parent_ref) {
+                    std::cerr << "ERROR: Multiple reference contigs detected that belong to different parent";
+                    std::cerr << " relationships. Reads must be aligned to contigs belonging to either a ";
+                    std::cerr << "single reference genome or a genome with multiple contigs/segments, whose ";
+                    std::cerr << "relations are defined in <reference_db>.names file (see documentation).";
+                    std::cerr << "SAM file: " << sam_filepath << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+            else {
+                parent_ref = args.db_index.parentOf(reference_name);
+            }
+        }
+        else {
+            if(!parent_ref.empty()) {
+                std::cerr << "ERROR: Multiple reference genomes are only supported if the <reference_db>.names";
+                std::cerr << " file is also present, which defines relations between parent organisms and ";
+                std::cerr << "their children chromosomes/segments (see documentation). SAM file: ";
+                std::cerr << sam_filepath << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            parent_ref = reference_name;
+        }
+    }
+
+    if(readgroups.empty()) {
+        std::cerr << "ERROR: Readgroup information (@RG) is not present in SAM file (" << sam_filepath << ").";
+        std::cerr << " @RG ID and SM must be set." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    for(int g = 0; g < readgroups.size(); ++g) {
+        if(readgroups[g].empty() || readgroup_samples[g].empty()) {
+            std::cerr << "ERROR: Readgroup (@RG) without ID or SM in SAM file (" << sam_filepath << ").";
+            std::cerr << " @RG ID and SM must be set." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    if(refs.empty()) {
+        std::cerr << "ERROR: Reference sequence information (@SQ) is not present in SAM file (" << sam_filepath << ").";
+        std::cerr << " @SQ SN and LN must be present only once (one contig in reference file)." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    for(int i = 0; i < refs.size(); ++i) {
+        if(ref_lens[i] <= 0) {
+            std::cerr << "ERROR: Reference sequence length is not positive, provided: ";
+            std::cerr << refs[i] << ", " << ref_lens[i] << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+std::vector< SamHeader > SamHeader::preflight(const std::vector< std::string > &sam_files, const Args &args, DispatchQueue* dispatcher)
+{
+    std::vector< SamHeader > headers;
+    for(const std::string &sam_file : sam_files) {
+        headers.emplace_back(sam_file);
+    }
+
+    std::atomic< int > num_read = ATOMIC_VAR_INIT(0);
+    int num_dispatched = 0;
+    for(int i = 0; i < headers.size(); ++i) {
+        SamHeader* header = &headers[i];
+        if(SamReader::isStream(header->sam_filepath)) {
+            continue;
+        }
+        dispatcher->dispatch([header, &num_read] () {
+            SamReader reader(header->sam_filepath, 1, SamReader::header_block_bytes);
+            std::string line;
+            header->read(reader, line);
+            num_read += 1;
+        });
+        num_dispatched++;
+    }
+    while(num_read != num_dispatched) {
+        std::this_thread::yield();
+    }
+
+    // { sample : header index where its parent reference was first seen }
+    std::unordered_map< std::string, int > sample_headers;
+    // { contig : header index where its length was first seen }
+    std::unordered_map< std::string, int > ref_headers;
+    // { sample : { contig : header index } }
+    std::unordered_map< std::string, std::unordered_map< std::string, int > > sample_ref_headers;
+    double pileup_bytes = 0;
+    for(int i = 0; i < headers.size(); ++i) {
+        SamHeader &header = headers[i];
+        if(!header.has_alignments) {
+            continue;
+        }
+        header.validate(args);
+
+        for(int r = 0; r < header.refs.size(); ++r) {
+            auto found = ref_headers.find(header.refs[r]);
+            if(found == ref_headers.end()) {
+                ref_headers[header.refs[r]] = i;
+                continue;
+            }
+            const SamHeader &other = headers[found->second];
+            for(int o = 0; o < other.refs.size(); ++o) {
+                if((other.refs[o] == header.refs[r]) && (other.ref_lens[o] != header.ref_lens[r])) {
+                    std::cerr << "ERROR: SAM files were aligned to different versions of the same reference contig ";
+                    std::cerr << "(@SQ LN differs). Contig: " << header.refs[r] << ", SAM files: ";
+                    std::cerr << other.sam_filepath << " (" << other.ref_lens[o] << "), " << header.sam_filepath;
+                    std::cerr << " (" << header.ref_lens[r] << ")" << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+        }
+
+        long ref_len_sum = 0;
+        for(const long &len : header.ref_lens) {
+            ref_len_sum += len;
+        }
+        for(int g = 0; g < header.readgroup_samples.size(); ++g) {
+            const std::string &sample = header.readgroup_samples[g];
+            bool first_group = true;
+            for(int h = 0; h < g; ++h) {
+                first_group = first_group && (header.readgroup_samples[h] != sample);
+            }
+            if(!first_group) {
+                continue;
+            }
+
+            auto found = sample_headers.find(sample);
+            if(found == sample_headers.end()) {
+                sample_headers[sample] = i;
+            }
+            else if(headers[found->second].parent_ref != header.parent_ref) {
+                std::cerr << "ERROR: All SAM files for a sample must be aligned to the same reference. If the ";
+                std::cerr << "reference used has multiple chromosomes/segments, they must be defined in ";
+                std::cerr << "<reference_db>.names (see documentation). Sample: " << sample;
+                std::cerr << ", clashing references: " << headers[found->second].parent_ref << ", ";
+                std::cerr << header.parent_ref << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+
+            for(const std::string &ref : header.refs) {
+                auto found_ref = sample_ref_headers[sample].find(ref);
+                if(found_ref != sample_ref_headers[sample].end()) {
+                    std::cerr << "ERROR: Duplicate sample + reference combination detected: " << sample << ", ";
+                    std::cerr << ref << ", SAM files: " << headers[found_ref->second].sam_filepath << ", ";
+                    std::cerr << header.sam_filepath << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+                sample_ref_headers[sample][ref] = i;
+            }
+
+            // Upper bound of the sample's in-memory pileup: four count and two sum arrays per position
+            pileup_bytes += (double)ref_len_sum * 4 * (sizeof(int) + (2 * sizeof(long)));
+        }
+    }
+
+    // Pages are only allocated where reads land, so this is a ceiling; warn only when it cannot possibly fit
+    double physical_bytes = (double)sysconf(_SC_PHYS_PAGES) * (double)sysconf(_SC_PAGESIZE);
+    if(args.spill_dir.empty() && (physical_bytes > 0) && (pileup_bytes > physical_bytes)) {
+        std::cerr.precision(3);
+        std::cerr << "WARNING: In-memory pileups of " << sample_headers.size() << " samples can take up to ";
+        std::cerr << (pileup_bytes / 1e9) << " GB, more than the " << (physical_bytes / 1e9) << " GB of physical ";
+        std::cerr << "memory. Out-of-core mode (-o) bounds pileup memory by the block size instead." << std::endl;
+    }
+    return headers;
+}
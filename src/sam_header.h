@@ -0,0 +1,45 @@
+#ifndef SIMPLE_SNP_SAM_HEADER_H
+#define SIMPLE_SNP_SAM_HEADER_H
+
+#include <string>
+#include <vector>
+#include "args.h"
+#include "sam_reader.h"
+
+class DispatchQueue;
+
+
+// Header block of one SAM file: reference contigs (@SQ), read groups (@RG) and sort order (@HD).  ParserJob reads
+// it before piling up reads, and the pre-flight stage reads the headers of every input up front so reference and
+// read group problems are reported before any file is parsed.
+class SamHeader {
+public:
+    SamHeader(const std::string &sam_filepath);
+
+    // Read header lines from reader; line is left holding the first alignment line.  Returns false for a file
+    // without alignments, which is skipped just like an empty file.
+    bool read(SamReader &reader, std::string &line);
+
+    // Exit with an error if the header is unusable on its own; sets parent_ref
+    void validate(const Args &args);
+
+    // Read the headers of all SAM files in parallel on dispatcher, validate each one and check them against each
+    // other (one parent reference per sample, one length per contig name, no sample + contig pair in two files).
+    // Exits on the first problem found.  Stdin and named pipes are left to ParserJob, since reading their header
+    // here would consume it.  Returns the headers in sam_files order (unread for streams).
+    static std::vector< SamHeader > preflight(const std::vector< std::string > &sam_files, const Args &args, DispatchQueue* dispatcher);
+
+    std::string sam_filepath;
+    bool has_alignments = false;
+    bool coordinate_sorted = false;
+    std::string parent_ref;
+    std::vector< std::string > refs;
+    std::vector< long > ref_lens;
+
+    // Parallel to each other, in header order
+    std::vector< std::string > readgroups;
+    std::vector< std::string > readgroup_samples;
+};
+
+
+#endif //SIMPLE_SNP_SAM_HEADER_H
@@ -0,0 +1,288 @@
+#include "sam_reader.h"
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+// Waiting on the other stage: yield for a short while, then sleep so a stage stalled on slow storage does not keep
+// its partner spinning on a core
+static void backoff(int &spins)
+{
+    if(spins < 64) {
+        spins++;
+        std::this_thread::yield();
+    }
+    else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+
+static long elapsedNs(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// Inflate a whole gzip file held in memory, including files of several concatenated gzip members (e.g. BGZF)
+static bool inflateAll(const std::vector< char > &compressed, std::vector< char > &contents)
+{
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if(inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    std::vector< char > out(1 << 16);
+    zs.next_in = (Bytef*)compressed.data();
+    zs.avail_in = compressed.size();
+    int ret = Z_OK;
+    while(true) {
+        zs.next_out = (Bytef*)out.data();
+        zs.avail_out = out.size();
+        ret = inflate(&zs, Z_NO_FLUSH);
+        contents.insert(contents.end(), out.data(), out.data() + (out.size() - zs.avail_out));
+        if((ret == Z_STREAM_END) && (zs.avail_in > 0)) {
+            ret = inflateReset(&zs);
+        }
+        else if((ret != Z_OK) || (zs.avail_in == 0 && zs.avail_out != 0)) {
+            break;
+        }
+    }
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+
+SamReader::SamReader(const std::string &sam_filepath, const int &read_ahead, const long &block_size)
+                     : sam_filepath(sam_filepath), _block_size(block_size)
+{
+    _open(read_ahead);
+}
+
+
+SamReader::SamReader(const std::string &sam_filepath,
+                     const int &read_ahead,
+                     const long &block_size,
+                     std::vector< char > &&contents)
+                     : sam_filepath(sam_filepath), _block_size(block_size)
+{
+    if((contents.size() >= 2) && ((unsigned char)contents[0] == 0x1f) && ((unsigned char)contents[1] == 0x8b)) {
+        if(!inflateAll(contents, _contents)) {
+            // Leave a damaged file to zlib's own reader, which reports it the same way as an unprefetched one
+            _contents.clear();
+            _open(read_ahead);
+            return;
+        }
+    }
+    else {
+        _contents = std::move(contents);
+    }
+    _in_memory = true;
+}
+
+
+void SamReader::_open(const int &read_ahead)
+{
+    struct stat sb;
+    if(sam_filepath == "-") {
+        int fd = dup(STDIN_FILENO);
+        _gz = (fd >= 0) ? gzdopen(fd, "rb") : nullptr;
+    }
+    else {
+        _gz = gzopen(sam_filepath.c_str(), "rb");
+        if((stat(sam_filepath.c_str(), &sb) == 0) && S_ISREG(sb.st_mode) && (sb.st_size <= _block_size)) {
+            // A plain file this small is read in one call, so a reader thread would have nothing to overlap with
+            // (a compressed one may take a few)
+            _block_size = std::max((long)sb.st_size, 1L);
+            _inline = true;
+        }
+    }
+    if(_gz == nullptr) {
+        _eof = true;
+        return;
+    }
+    gzbuffer(_gz, _block_size);
+
+    if(_inline) {
+        _blocks.resize(1);
+        _block_lens.assign(1, 0);
+        return;
+    }
+    // One slot for the block being parsed plus read_ahead slots the reader may fill ahead of it
+    _blocks.resize(read_ahead + 1);
+    _block_lens.assign(read_ahead + 1, 0);
+    _reader = std::thread(&SamReader::_readBlocks, this);
+}
+
+
+SamReader::~SamReader()
+{
+    close();
+}
+
+
+void SamReader::close()
+{
+    // The caller may stop early (e.g. after the header), so the reader is told to give up waiting for a free slot
+    _stop = true;
+    if(_reader.joinable()) {
+        _reader.join();
+    }
+    if(_gz != nullptr) {
+        gzclose(_gz);
+        _gz = nullptr;
+    }
+}
+
+
+bool SamReader::good() const
+{
+    return _in_memory || (_gz != nullptr);
+}
+
+
+bool SamReader::getline(std::string &line)
+{
+    line.clear();
+    if(_in_memory) {
+        if(_contents_pos == _contents.size()) {
+            return false;
+        }
+        const char* start = _contents.data() + _contents_pos;
+        long remaining = _contents.size() - _contents_pos;
+        const char* newline = (const char*)std::memchr(start, '\n', remaining);
+        long line_len = (newline != nullptr) ? (newline - start) : remaining;
+        line.assign(start, line_len);
+        _contents_pos += std::min(line_len + 1, remaining);
+        return true;
+    }
+    bool read_any = false;
+    while(true) {
+        if(!_holding || (_pos == _block_lens[_tail % _blocks.size()])) {
+            if(!_nextBlock()) {
+                return read_any;
+            }
+        }
+        const char* start = _blocks[_tail % _blocks.size()].get() + _pos;
+        long remaining = _block_lens[_tail % _blocks.size()] - _pos;
+        const char* newline = (const char*)std::memchr(start, '\n', remaining);
+        read_any = true;
+        if(newline != nullptr) {
+            line.append(start, newline - start);
+            _pos += (newline - start) + 1;
+            return true;
+        }
+        line.append(start, remaining);
+        _pos += remaining;
+    }
+}
+
+
+bool SamReader::isStream(const std::string &sam_filepath)
+{
+    struct stat sb;
+    if(sam_filepath == "-") {
+        return true;
+    }
+    return (stat(sam_filepath.c_str(), &sb) == 0) && S_ISFIFO(sb.st_mode);
+}
+
+
+void SamReader::_readBlocks()
+{
+    long head = 0;
+    while(true) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int spins = 0;
+        while((head - _tail.load(std::memory_order_acquire)) == (long)_blocks.size()) {
+            if(_stop) {
+                return;
+            }
+            backoff(spins);
+        }
+        reader_stall_ns += elapsedNs(start);
+
+        start = std::chrono::steady_clock::now();
+        long slot = head % _blocks.size();
+        _fillSlot(slot);
+        reader_busy_ns += elapsedNs(start);
+
+        head++;
+        _head.store(head, std::memory_order_release);
+        if((_block_lens[slot] == 0) || _stop) {
+            return;
+        }
+    }
+}
+
+
+void SamReader::_fillSlot(const long &slot)
+{
+    if(!_blocks[slot]) {
+        _blocks[slot].reset(new char[_block_size]);
+    }
+    int n = gzread(_gz, _blocks[slot].get(), _block_size);
+    if(n <= 0) {
+        // A truncated gzip member ends with 0 bytes read and Z_BUF_ERROR, not -1
+        int err = Z_OK;
+        const char* message = gzerror(_gz, &err);
+        if((n < 0) || (err != Z_OK)) {
+            // zlib prefixes its message with the path it was opened with
+            _read_error = (message != nullptr) ? message : "read error";
+            std::size_t path_end = _read_error.rfind(": ");
+            if(path_end != std::string::npos) {
+                _read_error = _read_error.substr(path_end + 2);
+            }
+        }
+    }
+    _block_lens[slot] = std::max(n, 0);
+}
+
+
+bool SamReader::_nextBlock()
+{
+    if(_eof) {
+        return false;
+    }
+    long slot = 0;
+    if(_inline) {
+        // The caller waits on its own read, so the read counts as both reader time and a parser stall
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        _fillSlot(slot);
+        long read_ns = elapsedNs(start);
+        reader_busy_ns += read_ns;
+        parser_stall_ns += read_ns;
+    }
+    else {
+        long tail = _tail.load(std::memory_order_relaxed);
+        if(_holding) {
+            tail++;
+            _tail.store(tail, std::memory_order_release);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int spins = 0;
+        while(_head.load(std::memory_order_acquire) == tail) {
+            backoff(spins);
+        }
+        parser_stall_ns += elapsedNs(start);
+        slot = tail % _blocks.size();
+    }
+
+    _holding = true;
+    _pos = 0;
+    if(_block_lens[slot] == 0) {
+        // An empty block marks the end of input; a failed read must not pass for it, or the pileups of a damaged
+        // file would silently stop short
+        if(!_read_error.empty()) {
+            std::cerr << "ERROR: Could not read SAM file (" << _read_error << "): " << sam_filepath << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        _eof = true;
+        return false;
+    }
+    return true;
+}
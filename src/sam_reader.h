@@ -0,0 +1,92 @@
+#ifndef SIMPLE_SNP_SAM_READER_H
+#define SIMPLE_SNP_SAM_READER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <zlib.h>
+
+
+// Line reader for SAM input that is plain text or gzip-compressed (detected from the content), from a regular
+// file, a named pipe or stdin ("-").  Reading is the first stage of a two-stage pipeline: a reader thread fills
+// raw (decompressed) blocks into a bounded single-producer/single-consumer ring, up to read_ahead blocks ahead of
+// the block the caller is parsing, so a stall on slow storage overlaps with parsing instead of adding to it.
+// Blocks are sized down to regular files smaller than a block and allocated only once the reader fills them, and a
+// regular file that fits in one block is read by the caller itself, so small files start no thread.
+class SamReader {
+public:
+    // Decompressed bytes per block for parsing, and the smaller blocks used when only the header is needed
+    static constexpr long block_bytes = 1 << 20;
+    static constexpr long header_block_bytes = 1 << 16;
+
+    SamReader(const std::string &sam_filepath, const int &read_ahead, const long &block_size);
+
+    // Read from the whole file contents already in memory (see InputPrefetcher): lines are served straight from
+    // contents, inflated first if it is gzip-compressed, without a reader thread
+    SamReader(const std::string &sam_filepath,
+              const int &read_ahead,
+              const long &block_size,
+              std::vector< char > &&contents);
+    ~SamReader();
+
+    bool good() const;
+
+    // Stop and join the reader stage; called by the destructor if not earlier
+    void close();
+
+    // Same contract as std::getline: the newline is dropped, and false means no more input
+    bool getline(std::string &line);
+
+    // Stdin and named pipes can only be read once, so they are neither pre-flighted nor cached
+    static bool isStream(const std::string &sam_filepath);
+
+    std::string sam_filepath;
+
+    // Stage timings (ns): reader time spent reading/decompressing and waiting on a full ring, and caller time
+    // spent waiting on an empty ring (or reading, for files read by the caller).  The reader values are final once
+    // the reader has been destroyed.
+    std::atomic< long > reader_busy_ns = ATOMIC_VAR_INIT(0);
+    std::atomic< long > reader_stall_ns = ATOMIC_VAR_INIT(0);
+    long parser_stall_ns = 0;
+
+private:
+    void _open(const int &read_ahead);
+    void _readBlocks();
+    void _fillSlot(const long &slot);
+    bool _nextBlock();
+
+    gzFile _gz = nullptr;
+    std::thread _reader;
+    long _block_size;
+
+    // No reader thread: the caller fills slot 0 itself whenever it needs the next block
+    bool _inline = false;
+
+    // Ring of blocks: the reader fills slot _head % size, the caller parses slot _tail % size.  Each index is
+    // written by one side only; a slot is handed over by the release store of the index that covers it.  Slots
+    // are left unallocated until first filled, and then not zeroed.
+    std::vector< std::unique_ptr< char[] > > _blocks;
+    std::vector< long > _block_lens;
+    std::atomic< long > _head = ATOMIC_VAR_INIT(0);
+    std::atomic< long > _tail = ATOMIC_VAR_INIT(0);
+    std::atomic< bool > _stop = ATOMIC_VAR_INIT(false);
+
+    // zlib's message when the read ending the input failed (e.g. a truncated gzip member); set by the reader before
+    // it publishes the empty end block
+    std::string _read_error;
+
+    // Whether the caller holds slot _tail, and the read position within it
+    bool _holding = false;
+    long _pos = 0;
+    bool _eof = false;
+
+    // In-memory input and the read position within it
+    bool _in_memory = false;
+    std::vector< char > _contents;
+    long _contents_pos = 0;
+};
+
+
+#endif //SIMPLE_SNP_SAM_READER_H
@@ -0,0 +1,58 @@
+#ifndef SIMPLE_SNP_SAMPLE_PILEUP_H
+#define SIMPLE_SNP_SAMPLE_PILEUP_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <memory_resource>
+#include "paged_array.h"
+
+
+// { 0-idx : { length : counts and quality sums } } of insertions or deletions.  The nodes come from the memory
+// resource the table was built with: the parse job's arena while reading SAM files, the heap everywhere else.
+typedef std::pmr::unordered_map< int, std::pmr::vector< long > > IndelLengths;
+typedef std::pmr::unordered_map< long, IndelLengths > IndelTable;
+
+
+// Pileup of one sample on one reference
+struct RefPileup {
+    RefPileup() = default;
+
+    // Indel tables allocating from arena, which the pileup keeps alive for as long as it holds them
+    explicit RefPileup(std::shared_ptr< std::pmr::memory_resource > arena)
+                       : arena(std::move(arena)),
+                         insertions(this->arena.get()),
+                         deletions(this->arena.get()) {}
+
+    // Moving takes over rhs's tables and the arena they live in.  There is no assignment: a pmr container keeps
+    // its old resource when assigned to, so pileups are constructed in place with the arena they will use.
+    RefPileup(RefPileup &&rhs) = default;
+
+    // Declared first so it is released after the tables that allocate from it
+    std::shared_ptr< std::pmr::memory_resource > arena;
+
+    std::vector< PagedArray< int > > nucleotide_counts;
+    std::vector< PagedArray< long > > qual_sums;
+    std::vector< PagedArray< long > > mapq_sums;
+
+    // { 0-idx : { length : < count, ins-qsum, left-qsum, right-qsum > } }
+    IndelTable insertions;
+
+    // { 0-idx : { length : < count, left-qsum, right-qsum > } }
+    IndelTable deletions;
+};
+
+
+// Pileup of one sample (@RG SM) of a SAM file.  A SAM file with read groups from several samples fills one of
+// these per sample in a single pass.
+struct SamplePileup {
+    std::string sample_id;
+    std::string readgroup;
+
+    // Indexed like the references of the SAM file's @SQ header
+    std::vector< RefPileup > refs;
+};
+
+
+#endif //SIMPLE_SNP_SAMPLE_PILEUP_H
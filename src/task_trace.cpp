@@ -0,0 +1,159 @@
+#include "task_trace.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+struct TraceEvent {
+    char phase;  // 'B' or 'E'
+    const char* name;
+    std::string detail;
+    long ns;
+};
+
+
+// Events of one thread, appended only by that thread
+struct ThreadTrace {
+    int tid;
+    std::string thread_name;
+    std::vector< TraceEvent > events;
+};
+
+
+static std::atomic< bool > trace_enabled = ATOMIC_VAR_INIT(false);
+static std::chrono::steady_clock::time_point trace_start;
+
+// Every thread's buffer, kept after the thread exits until the trace is written
+static std::mutex registry_mtx;
+static std::vector< std::unique_ptr< ThreadTrace > > registry;
+
+
+static ThreadTrace* threadTrace()
+{
+    static thread_local ThreadTrace* thread_trace = nullptr;
+    if(thread_trace == nullptr) {
+        std::unique_lock< std::mutex > lock(registry_mtx);
+        registry.push_back(std::make_unique< ThreadTrace >());
+        thread_trace = registry.back().get();
+        thread_trace->tid = registry.size();
+        thread_trace->events.reserve(1024);
+    }
+    return thread_trace;
+}
+
+
+static void record(const char &phase, const char* name, const std::string &detail)
+{
+    long ns = std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now()
+                                                                     - trace_start).count();
+    threadTrace()->events.push_back({phase, name, detail, ns});
+}
+
+
+static void writeJsonString(std::ofstream &ofs, const std::string &value)
+{
+    ofs << '"';
+    for(const char &c : value) {
+        if((c == '"') || (c == '\\')) {
+            ofs << '\\' << c;
+        }
+        else if((unsigned char)c < 0x20) {
+            ofs << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+        }
+        else {
+            ofs << c;
+        }
+    }
+    ofs << '"';
+}
+
+
+void TaskTrace::enable()
+{
+    trace_start = std::chrono::steady_clock::now();
+    trace_enabled = true;
+}
+
+
+bool TaskTrace::enabled()
+{
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+
+void TaskTrace::begin(const char* name, const std::string &detail)
+{
+    if(enabled()) {
+        record('B', name, detail);
+    }
+}
+
+
+void TaskTrace::end(const char* name)
+{
+    if(enabled()) {
+        record('E', name, "");
+    }
+}
+
+
+void TaskTrace::setThreadName(const std::string &thread_name)
+{
+    if(enabled()) {
+        threadTrace()->thread_name = thread_name;
+    }
+}
+
+
+bool TaskTrace::write(const std::string &json_path)
+{
+    std::ofstream ofs(json_path);
+    if(!ofs.is_open()) {
+        return false;
+    }
+    std::unique_lock< std::mutex > lock(registry_mtx);
+    // Timestamps are in microseconds
+    ofs << std::fixed << std::setprecision(3);
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+    bool first = true;
+    for(const std::unique_ptr< ThreadTrace > &thread_trace : registry) {
+        if(!thread_trace->thread_name.empty()) {
+            ofs << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": ";
+            ofs << thread_trace->tid << ", \"args\": {\"name\": ";
+            writeJsonString(ofs, thread_trace->thread_name);
+            ofs << "}}";
+            first = false;
+        }
+        for(const TraceEvent &event : thread_trace->events) {
+            ofs << (first ? "" : ",\n") << "{\"name\": ";
+            writeJsonString(ofs, event.name);
+            ofs << ", \"ph\": \"" << event.phase << "\", \"ts\": " << (event.ns / 1e3);
+            ofs << ", \"pid\": 1, \"tid\": " << thread_trace->tid;
+            if(!event.detail.empty()) {
+                ofs << ", \"args\": {\"detail\": ";
+                writeJsonString(ofs, event.detail);
+                ofs << "}";
+            }
+            ofs << "}";
+            first = false;
+        }
+    }
+    ofs << std::endl << "]}" << std::endl;
+    return ofs.good();
+}
+
+
+TraceScope::TraceScope(const char* name, const std::string &detail) : _name(name)
+{
+    TaskTrace::begin(_name, detail);
+}
+
+
+TraceScope::~TraceScope()
+{
+    TaskTrace::end(_name);
+}
@@ -0,0 +1,43 @@
+#ifndef SIMPLE_SNP_TASK_TRACE_H
+#define SIMPLE_SNP_TASK_TRACE_H
+
+#include <string>
+
+
+// Optional timeline of thread pool activity (-T), written in the Chrome Trace Event format for a trace viewer such
+// as Perfetto or chrome://tracing.  Each thread appends begin/end events to its own buffer, so recording takes no
+// lock (only a thread's first event registers its buffer), and nothing is recorded unless tracing was enabled.
+// Buffers outlive their threads; write() must only be called once every traced thread has been joined.
+class TaskTrace {
+public:
+    // Start recording; event times are relative to this call
+    static void enable();
+    static bool enabled();
+
+    // Events on the calling thread must nest: each end() closes the latest open begin().  detail is shown with the
+    // event in the viewer (e.g. the SAM file of a parse job).
+    static void begin(const char* name, const std::string &detail = "");
+    static void end(const char* name);
+
+    // Label of the calling thread's row in the viewer
+    static void setThreadName(const std::string &thread_name);
+
+    static bool write(const std::string &json_path);
+};
+
+
+// Begin/end events around a scope
+class TraceScope {
+public:
+    TraceScope(const char* name, const std::string &detail = "");
+    ~TraceScope();
+
+    TraceScope(const TraceScope& rhs) = delete;
+    TraceScope& operator=(const TraceScope& rhs) = delete;
+
+private:
+    const char* _name;
+};
+
+
+#endif //SIMPLE_SNP_TASK_TRACE_H
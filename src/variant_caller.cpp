@@ -0,0 +1,888 @@
+#include "variant_caller.h"
+#include "vcf_writer.h"
+#include "alloc_stats.h"
+#include "task_trace.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <functional>
+#include <utility>
+#include <cmath>
+
+
+// Genotype fields of a sample without a call at a variant site, where only its depth is known
+static void appendNoCall(std::string &var_info, std::string &vcf_info, const long &sample_depth, const int &num_alts)
+{
+    var_info += "./.:";
+    var_info += std::to_string(sample_depth);
+    var_info += ":.:.:.";
+    // GT:DP:AD:RO:QR:AO:QA
+    vcf_info += "./.:";
+    vcf_info += std::to_string(sample_depth);
+    vcf_info += ":.";
+    for(int i = 0; i < num_alts; ++i) {
+        vcf_info += ",.";
+    }
+    vcf_info += ":.:.";
+    for(int i = 1; i < num_alts; ++i) {
+        vcf_info += ",.";
+    }
+    vcf_info += ":.:.";
+    for(int i = 1; i < num_alts; ++i) {
+        vcf_info += ",.";
+    }
+}
+
+
+// Appends first + sep + second + ":" to info without building the concatenation as temporaries, which for
+// formatted qualities outgrow the small-string buffer and would allocate for every sample at every site
+static void appendPair(std::string &info, const std::string &first, const char &sep, const std::string &second)
+{
+    info += first;
+    info += sep;
+    info += second;
+    info += ':';
+}
+
+
+// Next comma-separated field of line from pos, as std::getline(ss, field, ',') would read it, but assigned into
+// field in place so its capacity is reused; pos moves past the comma
+static void nextField(const std::string &line, std::size_t &pos, std::string &field)
+{
+    if(pos >= line.size()) {
+        field.clear();
+        return;
+    }
+    std::size_t comma = line.find(',', pos);
+    if(comma == std::string::npos) {
+        comma = line.size();
+    }
+    field.assign(line, pos, comma - pos);
+    pos = comma + 1;
+}
+
+
+VariantCaller::VariantCaller(Args &args,
+                             ConcurrentBufferQueue* buffer_q,
+                             FastaParser* fasta_parser,
+                             const std::string &parent_ref,
+                             const std::vector< std::string > &sample_names,
+                             const std::vector< std::string > &refs,
+                             const std::string &output_prefix,
+                             const std::string &command_string)
+                             : _args(args),
+                             _buffer_q(buffer_q),
+                             _fasta_parser(fasta_parser),
+                             _parent_ref(parent_ref),
+                             _sample_names(sample_names),
+                             _refs(refs),
+                             _output_prefix(output_prefix),
+                             _command_string(command_string)
+{
+    // Samples and references are looked up by id from here on; names only appear in the output
+    _parent_ref_id = _buffer_q->ref_names.intern(_parent_ref);
+    for(const std::string &ref : _refs) {
+        _ref_ids.push_back(_buffer_q->ref_names.intern(ref));
+    }
+    for(const std::string &sample : _sample_names) {
+        _sample_ids.push_back(_buffer_q->sample_names.intern(sample));
+    }
+    _views.resize(_sample_names.size());
+    _blocks.resize(_sample_names.size());
+}
+
+
+void VariantCaller::_loadBlock(const int &ref_idx, const long &start, const long &stop)
+{
+    const std::string &ref = _refs[ref_idx];
+    const int &ref_id = _ref_ids[ref_idx];
+    if(_buffer_q->spill_dir.empty()) {
+        std::unique_lock< std::mutex > lock = _buffer_q->lockPileups();
+        for(int s = 0; s < _sample_ids.size(); ++s) {
+            const RefPileup* ref_pileup = nullptr;
+            if(_sample_ids[s] < _buffer_q->all_pileups.size()) {
+                const std::vector< std::unique_ptr< RefPileup > > &sample_pileups = _buffer_q->all_pileups[_sample_ids[s]];
+                if(ref_id < sample_pileups.size()) {
+                    ref_pileup = sample_pileups[ref_id].get();
+                }
+            }
+            if(ref_pileup == nullptr) {
+                std::cerr << "ERROR: No pileup for sample + reference combination: " << _sample_names[s] << ", ";
+                std::cerr << ref << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            _views[s].nucl = &ref_pileup->nucleotide_counts;
+            _views[s].qual = &ref_pileup->qual_sums;
+            _views[s].mapq = &ref_pileup->mapq_sums;
+            _views[s].ins = &ref_pileup->insertions;
+            _views[s].del = &ref_pileup->deletions;
+        }
+        return;
+    }
+
+    // Out-of-core: advance every sample's spill to the same block of positions, so only one block per sample is
+    // resident at a time.  A sample without reads on this reference reads as zero depth.
+    for(int s = 0; s < _sample_ids.size(); ++s) {
+        std::unique_lock< std::mutex > lock = _buffer_q->lockPileups();
+        const std::vector< std::string > &sample_spills = _buffer_q->all_spills.at(_sample_ids[s]);
+        std::string spill_path = (ref_id < sample_spills.size()) ? sample_spills[ref_id] : "";
+        for(int r = 0; spill_path.empty(); ++r) {
+            spill_path = sample_spills.at(r);
+        }
+        lock.unlock();
+        std::unique_ptr< PileupSpillReader > &reader = _spill_readers[spill_path];
+        if(!reader) {
+            reader = std::make_unique< PileupSpillReader >(spill_path);
+        }
+        PileupBlock &block = _blocks[s];
+        reader->readBlock(ref, start, stop, block);
+        _views[s].nucl = &block.nucleotide_counts;
+        _views[s].qual = &block.qual_sums;
+        _views[s].mapq = &block.mapq_sums;
+        _views[s].ins = &block.insertions;
+        _views[s].del = &block.deletions;
+    }
+}
+
+
+void VariantCaller::run()
+{
+    TraceScope trace("VariantCaller", _parent_ref);
+    // Waits on parsing and VCF writing are timed separately and left out of the calling time
+    StageTimer calling_timer(_buffer_q->metrics, RunMetrics::variant_calling);
+    long wait_ns = 0;
+    long vcf_write_ns = 0;
+    long num_positions = 0;
+
+    std::ofstream ofs(_args.output_dir + "/" + _output_prefix + "all_sample_variants.tsv");
+    std::ofstream ofs2(_args.output_dir + "/" + _output_prefix + "dominant_population_variants.tsv");
+
+    std::vector< long > contig_lens;
+    for(int i = 0; i < _refs.size(); ++i) {
+        contig_lens.push_back(_fasta_parser->headers_lens.at(_refs[i]));
+    }
+
+    std::string vcf_path = _args.output_dir + "/" + _output_prefix + "dominant_population_variants.vcf";
+    VcfWriter vcf_writer(vcf_path);
+    vcf_writer.open();
+    vcf_writer.writeHeaders(_args.reference_path,
+                            _command_string,
+                            _refs,
+                            contig_lens);
+    vcf_writer.writeSamples(_sample_names);
+
+    ofs << "Position";
+    ofs2 << "Position";
+    for(int i = 0; i < _sample_names.size(); ++i) {
+        ofs << '\t' << _sample_names[i];
+        ofs2 << '\t' << _sample_names[i];
+    }
+    ofs << std::endl;
+    ofs2 << std::endl;
+
+    std::string this_nucleotides = "ACGT";
+    static thread_local CallingContext context;
+    std::vector< long > &population_allele_counts = context.population_allele_counts;
+    std::unordered_map< int, long > &population_insertions = context.population_insertions;
+    std::unordered_map< int, long > &population_deletions = context.population_deletions;
+    vcfLineData &vcf_line_data = context.vcf_line_data;
+    std::string &alts_present_at_pos = context.alts_present_at_pos;
+    GenotypeArena &positional_variants = context.positional_variants;
+    GenotypeArena &vcf_variants = context.vcf_variants;
+
+    // Variant sites, and heap allocations while calling them (make ALLOC_STATS=1) to confirm the loop reaches a
+    // steady state: once the context has grown, sites should stop allocating
+    long num_sites = 0;
+    long site_allocations = 0;
+    long num_allocating_sites = 0;
+    long last_allocating_site = 0;
+    for(int r = 0; r < _refs.size(); ++r) {
+        std::string this_ref = _refs[r];
+        StageTimer wait_timer(_buffer_q->metrics, RunMetrics::calling_wait);
+        _buffer_q->waitRefReady(_parent_ref_id, _ref_ids[r]);
+        wait_ns += wait_timer.stop();
+        const PackedSequence &this_seq = _fasta_parser->getSequence(this_ref);
+        num_positions += this_seq.length();
+        // Sample pileups are visited one block of positions at a time; in memory the whole reference is one block
+        long block_size = _buffer_q->spill_dir.empty() ? this_seq.length() : _args.spill_block_size;
+        long block_start = 0;
+        long block_stop = 0;
+        for(long j = 0; j < this_seq.length(); ++j) {
+            if(j == block_stop) {
+                block_start = j;
+                block_stop = std::min(this_seq.length(), j + block_size);
+                _loadBlock(r, block_start, block_stop);
+            }
+            long start_allocations = threadAllocations();
+            // Index of j in the current block's count/sum arrays
+            long k = j - block_start;
+            // 0-3 in pileup allele order, -1 for ambiguous reference bases (matches no allele)
+            int ref_base_idx = this_seq.baseIndex(j);
+            long population_depth = 0;
+            population_allele_counts.assign(4, 0);
+            if(!population_insertions.empty()) {
+                population_insertions.clear();
+            }
+            if(!population_deletions.empty()) {
+                population_deletions.clear();
+            }
+
+            // First pass to look at population metrics
+            for(int s = 0; s < _sample_names.size(); ++s) {
+//                std::cout << (j+1) << '\t' << sample << std::endl;
+                const std::vector< PagedArray< int > > *nucl = _views[s].nucl;
+                const IndelTable *ins = _views[s].ins;
+                const IndelTable *del = _views[s].del;
+                long sample_depth = 0;
+                for(int i = 0; i < population_allele_counts.size(); ++i) {
+                    population_depth += (*nucl)[i][k];
+                    sample_depth += (*nucl)[i][k];
+                }
+
+//                std::cout << "\tcheck1" << std::endl;
+
+                if((*ins).count(j)) {
+                    for(auto &[len, ins_vec] : (*ins).at(j)) {
+                        population_depth += ins_vec[0];
+                        sample_depth += ins_vec[0];
+                    }
+                }
+
+                if((*del).count(j)) {
+                    for(auto &[len, del_vec] : (*del).at(j)) {
+                        population_depth += del_vec[0];
+                        sample_depth += del_vec[0];
+                    }
+                }
+
+                if(population_depth < _args.min_inter_sample_depth) {
+                    continue;
+                }
+
+                for(int i = 0; i < population_allele_counts.size(); ++i) {
+                    double this_allele_freq = (double)(*nucl)[i][k] / (double)sample_depth;
+                    if(this_allele_freq >= _args.min_major_freq) {
+                        if(i != ref_base_idx) {
+                            population_allele_counts[i] += (*nucl)[i][k];
+                        }
+                    }
+                }
+
+//                std::cout << "\tcheck2" << std::endl;
+
+                // indel frequency is calculated across all indel lengths to identify candidate indels at a given
+                // position. This is to mitigate the effect of nanopore sequencing noise, particular when indels
+                // are identified near homopolymer runs.
+                if((*ins).count(j)) {
+                    double this_ins_freq = 0;
+                    for(auto &[len, ins_vec] : (*ins).at(j)) {
+                         this_ins_freq += (double)ins_vec[0];
+                    }
+                    this_ins_freq /= (double)sample_depth;
+                    if(this_ins_freq >= _args.min_major_freq) {
+                        for(auto &[len, ins_vec] : (*ins).at(j)) {
+                            if(!population_insertions.count(len)) {
+                                population_insertions[len] = ins_vec[0];
+                            }
+                            else {
+                                population_insertions.at(len) += ins_vec[0];
+                            }
+                        }
+                    }
+                }
+
+                if((*del).count(j)) {
+                    double this_del_freq = 0;
+                    for(auto &[len, del_vec] : (*del).at(j)) {
+                        this_del_freq += (double)del_vec[0];
+                    }
+                    this_del_freq /= (double)sample_depth;
+                    if(this_del_freq >= _args.min_major_freq) {
+                        for(auto &[len, del_vec] : (*del).at(j)) {
+                            if(!population_deletions.count(len)) {
+                                population_deletions[len] = del_vec[0];
+                            }
+                            else {
+                                population_deletions[len] += del_vec[0];
+                            }
+                        }
+                    }
+                }
+            }
+
+            bool meets_population_threshold = false;
+            for(int i = 0; i < population_allele_counts.size(); ++i) {
+                meets_population_threshold |= (population_allele_counts[i] > _args.min_inter_sample_alt);
+            }
+
+//            std::cout << "\tcheck3" << std::endl;
+
+            long population_ins_sums = 0;
+            for(auto &[len, val] : population_insertions) {
+                population_ins_sums += val;
+            }
+//            meets_population_threshold |= (population_ins_sums > _args.min_inter_sample_alt);
+
+            long population_del_sums = 0;
+            for(auto &[len, val] : population_deletions) {
+                population_del_sums += val;
+            }
+//            meets_population_threshold |= (population_del_sums > _args.min_inter_sample_alt);
+
+            if(!meets_population_threshold) {
+                continue;
+            }
+
+            // Second pass to establish variants present and their codes
+            vcf_line_data.clear();
+            vcf_line_data.dp = 0;
+
+            bool position_has_variant = false;
+            bool position_has_major_variant = false;
+            alts_present_at_pos.clear();
+            for(int s = 0; s < _sample_names.size(); ++s) {
+                const std::vector< PagedArray< int > > *nucl = _views[s].nucl;
+                const IndelTable *ins = _views[s].ins;
+                const IndelTable *del = _views[s].del;
+                long sample_depth = 0;
+                for(int i = 0; i < population_allele_counts.size(); ++i) {
+                    sample_depth += (*nucl)[i][k];
+                }
+
+
+                if((*ins).count(j)) {
+                    for(auto &[len, ins_vec] : (*ins).at(j)) {
+                        sample_depth += ins_vec[0];
+                    }
+                }
+
+                if((*del).count(j)) {
+                    for(auto &[len, del_vec] : (*del).at(j)) {
+                        sample_depth += del_vec[0];
+                    }
+                }
+
+                vcf_line_data.dp += sample_depth;
+
+                for(int i = 0; i < population_allele_counts.size(); ++i) {
+                    double this_allele_freq = (double)(*nucl)[i][k] / (double)sample_depth;
+                    if((this_allele_freq >= _args.min_minor_freq) && ((*nucl)[i][k] >= _args.min_intra_sample_alt) && (sample_depth > _args.min_intra_sample_depth)) {
+                        if(i != ref_base_idx) {
+                            if(alts_present_at_pos.find(this_nucleotides.at(i)) == std::string::npos) {
+                                alts_present_at_pos += this_nucleotides.at(i);
+                            }
+                            position_has_variant = true;
+                            if(this_allele_freq >= _args.min_major_freq) {
+                                position_has_major_variant = true;
+                            }
+                        }
+                    }
+                }
+
+                if((*ins).count(j)) {
+                    double this_ins_freq = 0;
+                    long this_ins_count = 0;
+                    for(auto &[len, ins_vec] : (*ins).at(j)) {
+                        this_ins_count += ins_vec[0];
+                        this_ins_freq += (double)ins_vec[0];
+                    }
+                    this_ins_freq /= (double)sample_depth;
+                    if((this_ins_freq >= _args.min_minor_freq) && (this_ins_count >= _args.min_intra_sample_alt) && (sample_depth > _args.min_intra_sample_depth)) {
+//                        std::cout << sample << '\t' << this_ref << ':' << std::to_string(j+1) << "\tInsertion\t" << this_ins_count;
+//                        std::cout << '\t' << this_ins_freq << std::endl;
+//                        for(auto &[len, ins_vec] : (*ins).at(j)) {
+//                            std::cout << '\t' << len << '\t' << ins_vec[0] << '\t' << ins_vec[1] << '\t';
+//                            std::cout << ins_vec[2] << '\t' << ins_vec[3] << std::endl;
+//                        }
+                        if(alts_present_at_pos.find('I') == std::string::npos) {
+//                            alts_present_at_pos += 'I';
+                        }
+//                        position_has_variant = true;
+                        if(this_ins_freq >= _args.min_major_freq) {
+//                            position_has_major_variant = true;
+                        }
+                    }
+                }
+
+                if((*del).count(j)) {
+                    double this_del_freq = 0;
+                    long this_del_count = 0;
+                    for(auto &[len, del_vec] : (*del).at(j)) {
+                        this_del_count += del_vec[0];
+                        this_del_freq += (double)del_vec[0];
+                    }
+                    this_del_freq /= (double)sample_depth;
+                    if((this_del_freq >= _args.min_minor_freq) && (this_del_count >= _args.min_intra_sample_alt) && (sample_depth > _args.min_intra_sample_depth)) {
+                        if(alts_present_at_pos.find('D') == std::string::npos) {
+//                            alts_present_at_pos += 'D';
+                        }
+//                        position_has_variant = true;
+                        if(this_del_freq >= _args.min_major_freq) {
+//                            position_has_major_variant = true;
+//                            std::cout << sample << '\t' << this_ref << ':' << std::to_string(j+1) << "\tDeletion\t" << this_del_count;
+//                            std::cout << '\t' << this_del_freq << std::endl;
+//                            for(auto &[len, del_vec] : (*del).at(j)) {
+//                                std::cout << '\t' << len << '\t' << del_vec[0] << '\t' << del_vec[1] << '\t';
+//                                std::cout << del_vec[2] << std::endl;
+//                            }
+                        }
+                    }
+                }
+            }
+
+//            std::cout << "\tcheck4" << std::endl;
+
+            if(!position_has_variant) {
+                continue;
+            }
+
+            vcf_line_data.chrom = this_ref;
+            vcf_line_data.ref = this_seq.at(j);
+            vcf_line_data.pos = j+1;
+            vcf_line_data.qual = 0;
+            vcf_line_data.ns = 0;
+            vcf_line_data.ro = 0;
+            vcf_line_data.mqmr = 0;
+            vcf_line_data.ao_sum = 0;
+            vcf_line_data.nsa = 0;
+            for(int i = 0; i < alts_present_at_pos.size(); ++i) {
+
+                if(alts_present_at_pos.at(i) == 'I') {
+                    vcf_line_data.type.push_back("ins");
+                }
+                else if(alts_present_at_pos.at(i) == 'D') {
+                    vcf_line_data.type.push_back("del");
+                }
+                else {
+                    vcf_line_data.type.push_back("snp");
+                }
+
+                // TODO:  needs to be moved below with incorporation of indels
+                vcf_line_data.cigar.push_back("1X");
+                vcf_line_data.af.push_back(0);
+                vcf_line_data.alt.push_back("");
+                vcf_line_data.alt[i] += alts_present_at_pos.at(i);
+                vcf_line_data.ao.push_back(0);
+                vcf_line_data.mqm.push_back(0);
+                vcf_line_data.alt_ns.push_back(0);
+                vcf_line_data.ac.push_back(0);
+            }
+
+//            std::cout << "\tcheck5" << std::endl;
+
+            // Third pass to assign variants
+            positional_variants.clear();
+            vcf_variants.clear();
+            for(int s = 0; s < _sample_names.size(); ++s) {
+                const std::string &sample = _sample_names[s];
+                std::string &final_var_info = positional_variants.field();
+                std::string &final_vcf_info = vcf_variants.field();
+//                std::cout << "\tcheck 5.1" << std::endl;
+                const std::vector< PagedArray< int > > *nucl = _views[s].nucl;
+                const std::vector< PagedArray< long > > *qual = _views[s].qual;
+                const std::vector< PagedArray< long > > *mapq = _views[s].mapq;
+                const IndelTable *ins = _views[s].ins;
+                const IndelTable *del = _views[s].del;
+                long sample_depth = 0;
+                int ref_allele_count;
+                double ref_qual;
+                for(int i = 0; i < population_allele_counts.size(); ++i) {
+                    sample_depth += (*nucl)[i][k];
+                    if(i == ref_base_idx) {
+                        ref_allele_count = (*nucl)[i][k];
+                        ref_qual = (double)(*qual)[i][k];
+                        vcf_line_data.mqmr += (double)(*mapq)[i][k];
+                    }
+                }
+
+//                std::cout << "\tcheck 5.2" << std::endl;
+
+                if((*ins).count(j)) {
+                    for(auto &[len, ins_vec] : (*ins).at(j)) {
+                        sample_depth += ins_vec[0];
+                    }
+                }
+
+                if((*del).count(j)) {
+                    for(auto &[len, del_vec] : (*del).at(j)) {
+                        sample_depth += del_vec[0];
+                    }
+                }
+
+                if(sample_depth < _args.min_intra_sample_depth) {
+                    appendNoCall(final_var_info, final_vcf_info, sample_depth, alts_present_at_pos.size());
+                    positional_variants.endField();
+                    vcf_variants.endField();
+                    continue;
+                }
+
+//                std::cout << "\tcheck 5.3" << std::endl;
+
+                context.num_alleles = 0;
+                for(int i = 0; i < population_allele_counts.size(); ++i) {
+//                    std::cout << "\tcheck 5.3.1" << std::endl;
+                    double this_allele_freq = (double)(*nucl)[i][k] / (double)sample_depth;
+                    if((this_allele_freq >= _args.min_minor_freq) && ((*nucl)[i][k] >= _args.min_intra_sample_alt) && (sample_depth > _args.min_intra_sample_depth)) {
+                        if(context.num_alleles == context.alleles.size()) {
+                            context.alleles.emplace_back();
+                        }
+                        std::pair< double, std::string > &allele = context.alleles[context.num_alleles++];
+                        allele.first = this_allele_freq;
+                        std::string &var_info = allele.second;
+                        var_info.clear();
+                        if(i == ref_base_idx) {
+                            // Reference allele
+                            var_info += "0,";
+                        }
+                        else {
+                            std::size_t found = alts_present_at_pos.find(this_nucleotides.at(i));
+                            if(found == std::string::npos) {
+                                std::cerr << "Nucleotide called as variant (" << this_nucleotides.at(i);
+                                std::cerr << ") but not in alts (" << alts_present_at_pos << "), position: ";
+                                std::cerr << (j+1) << ", sample: " << sample << std::endl;
+                                std::exit(EXIT_FAILURE);
+                            }
+//                            std::cout << "\t\tfound: " << found << "\talts: " << alts_present_at_pos << std::endl;
+                            var_info += std::to_string(found + 1);
+                            var_info += ",";
+                            vcf_line_data.mqm[found] += (double)(*mapq)[i][k];
+                            vcf_line_data.ao[found] += (*nucl)[i][k];
+                            vcf_line_data.ao_sum += (*nucl)[i][k];
+                            vcf_line_data.qual += (double)(*qual)[i][k];
+                        }
+//                        std::cout << "\tcheck 5.3.2" << std::endl;
+
+                        var_info += std::to_string((*nucl)[i][k]);
+                        var_info += ",";
+                        var_info += std::to_string((double)(*qual)[i][k] / (double)(*nucl)[i][k]);
+                        var_info += ",";
+                        var_info += std::to_string((double)(*mapq)[i][k] / (double)(*nucl)[i][k]);
+                        var_info += ",";
+                        var_info += std::to_string(ref_allele_count);
+                        var_info += ",";
+                        if(ref_allele_count > 0) {
+                            var_info += std::to_string(ref_qual / (double)ref_allele_count);
+                        }
+                        else {
+                            var_info += ".";
+                        }
+                        vcf_line_data.ro += ref_allele_count;
+                    }
+//                    std::cout << "\tcheck 5.3.3" << std::endl;
+                }
+
+//                std::cout << "\tcheck6" << std::endl;
+
+                if((*ins).count(j)) {
+                    double this_ins_freq = 0;
+                    long this_ins_count = 0;
+                    for(auto &[len, ins_vec] : (*ins).at(j)) {
+                        this_ins_count += ins_vec[0];
+                        this_ins_freq += (double)ins_vec[0];
+                    }
+                    this_ins_freq /= (double)sample_depth;
+                    if((this_ins_freq >= _args.min_minor_freq) && (this_ins_count >= _args.min_intra_sample_alt)) {
+//                        std::cout << this_ref << ':' << std::to_string(j+1) << "\tInsertion\t" << this_ins_count;
+//                        std::cout << '\t' << this_ins_freq << std::endl;
+//                        for(auto &[len, ins_vec] : (*ins).at(j)) {
+//                            std::cout << '\t' << len << '\t' << ins_vec[0] << '\t' << ins_vec[1] << '\t';
+//                            std::cout << ins_vec[2] << '\t' << ins_vec[3] << std::endl;
+//                        }
+                    }
+                }
+
+                if((*del).count(j)) {
+                    double this_del_freq = 0;
+                    long this_del_count = 0;
+                    for(auto &[len, del_vec] : (*del).at(j)) {
+                        this_del_count += del_vec[0];
+                        this_del_freq += (double)del_vec[0];
+                    }
+                    this_del_freq /= (double)sample_depth;
+                    if((this_del_freq >= _args.min_minor_freq) && (this_del_count >= _args.min_intra_sample_alt)) {
+//                        std::cout << this_ref << ':' << std::to_string(j+1) << "\tDeletion\t" << this_del_count;
+//                        std::cout << '\t' << this_del_freq << std::endl;
+//                        for(auto &[len, del_vec] : (*del).at(j)) {
+//                            std::cout << '\t' << len << '\t' << del_vec[0] << '\t' << del_vec[1] << '\t';
+//                            std::cout << del_vec[2] << std::endl;
+//                        }
+                    }
+                }
+
+                // Most frequent allele first (the order a max-heap would pop them in)
+                std::sort(context.alleles.begin(),
+                          context.alleles.begin() + context.num_alleles,
+                          std::greater< std::pair< double, std::string > >());
+
+                if(context.num_alleles > 2) {
+                    std::cerr << "Tri-allelic site detected at sample:position, " << sample << " ";
+                    std::cerr << this_ref << ":" << (j+1) << std::endl;
+                    for(int a = 0; a < context.num_alleles; ++a) {
+                        std::cerr << context.alleles[a].first << '\t' << context.alleles[a].second << std::endl;
+                    }
+//                    std::cout << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+
+//                std::cout << "\tcheck7" << std::endl;
+
+                if(context.num_alleles == 2) {
+//                    std::cout << "\tcheck2 qsize 2" << std::endl;
+                    const std::string &var_info1 = context.alleles[0].second;
+                    const std::string &var_info2 = context.alleles[1].second;
+                    std::size_t pos1 = 0;
+                    std::size_t pos2 = 0;
+
+                    std::string temp1, temp2;
+                    std::string ro, qr;
+                    std::string gt1, ao1, gq1, qa1;
+                    std::string gt2, ao2, gq2, qa2;
+
+                    // Genotype
+                    nextField(var_info1, pos1, gt1);
+                    nextField(var_info2, pos2, gt2);
+                    appendPair(final_var_info, gt1, '/', gt2);
+                    appendPair(final_vcf_info, gt1, '/', gt2);
+
+                    if((gt1 != "0") or (gt2 != "0")) {
+                        vcf_line_data.nsa++;
+                    }
+                    vcf_line_data.ns++;
+
+                    // Depth
+                    final_var_info += std::to_string(sample_depth) + ":";
+                    final_vcf_info += std::to_string(sample_depth) + ":";
+
+                    // Allele count
+                    nextField(var_info1, pos1, ao1);
+                    nextField(var_info2, pos2, ao2);
+                    appendPair(final_var_info, ao1, ',', ao2);
+
+                    // Mean quality score
+                    nextField(var_info1, pos1, qa1);
+                    nextField(var_info2, pos2, qa2);
+                    appendPair(final_var_info, temp1, ',', temp2);
+
+                    // Mean mapq score
+                    nextField(var_info1, pos1, temp1);
+                    nextField(var_info2, pos2, temp2);
+                    appendPair(final_var_info, temp1, ',', temp2);
+
+                    if(gt1 != "0") {
+                        vcf_line_data.alt_ns[std::stoi(gt1.c_str()) - 1] += 1;
+                    }
+                    if(gt2 != "0") {
+                        vcf_line_data.alt_ns[std::stoi(gt2.c_str()) - 1] += 1;
+                    }
+
+                    // Ref allele count
+                    nextField(var_info1, pos1, ro);
+                    final_var_info += ro + ":";
+
+                    // Mean ref allele qual score
+                    nextField(var_info1, pos1, qr);
+                    final_var_info += qr;
+
+                    std::vector< int > &sample_vcf_ao = context.sample_vcf_ao;
+                    std::vector< double > &sample_vcf_qa = context.sample_vcf_qa;
+                    sample_vcf_ao.assign(vcf_line_data.ao.size(), 0);
+                    sample_vcf_qa.assign(vcf_line_data.ao.size(), 0);
+
+                    int gt1_idx = std::stoi(gt1.c_str()) - 1;
+                    int gt2_idx = std::stoi(gt2.c_str()) - 1;
+
+//                    std::cout << (j+1) << '\t' << sample << '\t' << gt1_idx << '\t' << gt2_idx << std::endl;
+
+                    if(gt1_idx >= 0) {
+                        sample_vcf_ao[gt1_idx] = std::stoi(ao1.c_str());
+                        sample_vcf_qa[gt1_idx] = std::stod(qa1.c_str());
+                        vcf_line_data.ac[gt1_idx]++;
+                    }
+                    if(gt2_idx >= 0) {
+                        sample_vcf_ao[gt2_idx] = std::stoi(ao2.c_str());
+                        sample_vcf_qa[gt2_idx] = std::stod(qa2.c_str());
+                        vcf_line_data.ac[gt2_idx]++;
+                    }
+
+                    final_vcf_info += ro;
+                    for(int i = 0; i < sample_vcf_ao.size(); ++i) {
+                        final_vcf_info += ',' + std::to_string(sample_vcf_ao[i]);
+                    }
+
+                    final_vcf_info += ':';
+                    appendPair(final_vcf_info, ro, ':', qr);
+                    final_vcf_info += std::to_string(sample_vcf_ao[0]);
+                    for(int i = 1; i < sample_vcf_ao.size(); ++i) {
+                        final_vcf_info += ',' + std::to_string(sample_vcf_ao[i]);
+                    }
+                    final_vcf_info += ":" + std::to_string(sample_vcf_qa[0]);
+                    for(int i = 1; i < sample_vcf_qa.size(); ++i) {
+                        final_vcf_info += ',' + std::to_string(sample_vcf_qa[i]);
+                    }
+                }
+                else if(context.num_alleles == 1) {
+//                    std::cout << "\tcheck2 qsize 1" << std::endl;
+                    const std::string &var_info = context.alleles[0].second;
+                    std::size_t pos = 0;
+                    std::string temp;
+                    std::string gt, ro, ao, gq, qr, qa;
+                    nextField(var_info, pos, gt);
+                    appendPair(final_var_info, gt, '/', gt);
+                    appendPair(final_vcf_info, gt, '/', gt);
+                    final_var_info += std::to_string(sample_depth) + ":";
+                    final_vcf_info += std::to_string(sample_depth) + ":";
+                    nextField(var_info, pos, ao);
+                    appendPair(final_var_info, ao, ',', ao);
+                    nextField(var_info, pos, qa);
+                    appendPair(final_var_info, qa, ',', qa);
+                    nextField(var_info, pos, temp);
+                    appendPair(final_var_info, temp, ',', temp);
+                    nextField(var_info, pos, ro);
+                    final_var_info += ro + ":";
+                    nextField(var_info, pos, qr);
+                    final_var_info += qr;
+
+//                    std::cout << "\t\tgt: " << gt << std::endl;
+
+                    if(gt == "0") {
+                        int sample_nucl_idx;
+                        final_vcf_info += ro;
+                        for(int i = 0; i < vcf_line_data.ao.size(); ++i) {
+                            sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(i));
+//                            std::cout << "\t\tnucl idx 1: " << sample_nucl_idx << std::endl;
+                            final_vcf_info += ',' + std::to_string((*nucl)[sample_nucl_idx][k]);
+                        }
+                        final_vcf_info += ':';
+                        appendPair(final_vcf_info, ro, ':', qr);
+                        sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(0));
+//                        std::cout << "\t\tnucl idx 2: " << sample_nucl_idx << std::endl;
+                        final_vcf_info += std::to_string((*nucl)[sample_nucl_idx][k]);
+                        for(int i = 1; i < vcf_line_data.ao.size(); ++i) {
+                            sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(i));
+//                            std::cout << "\t\tnucl idx 3: " << sample_nucl_idx << std::endl;
+                            final_vcf_info += ',' + std::to_string((*nucl)[sample_nucl_idx][k]);
+                        }
+                        sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(0));
+//                        std::cout << "\t\tnucl idx 4: " << sample_nucl_idx << std::endl;
+                        if((*nucl)[sample_nucl_idx][k] > 0) {
+                            final_vcf_info += ":" + std::to_string((double)(*qual)[sample_nucl_idx][k] /
+                                                                   (double)(*nucl)[sample_nucl_idx][k]);
+                        }
+                        else {
+                            final_vcf_info += ":.";
+                        }
+
+                        for(int i = 1; i < vcf_line_data.ao.size(); ++i) {
+                            sample_nucl_idx = this_nucleotides.find(alts_present_at_pos.at(i));
+//                            std::cout << "\t\tnucl idx 5: " << sample_nucl_idx << std::endl;
+                            final_vcf_info += ',';
+                            if((*nucl)[sample_nucl_idx][k] > 0) {
+                                final_vcf_info += std::to_string((double)(*qual)[sample_nucl_idx][k] /
+                                                                 (double)(*nucl)[sample_nucl_idx][k]);
+                            }
+                            else {
+                                final_vcf_info += '.';
+                            }
+                        }
+                    }
+                    else {
+                        final_vcf_info += ro;
+                        final_vcf_info += ',';
+                        final_vcf_info += ao;
+                        final_vcf_info += ':';
+                        final_vcf_info += ro;
+                        final_vcf_info += ':';
+                        final_vcf_info += qr;
+                        final_vcf_info += ':';
+                        final_vcf_info += ao;
+                        final_vcf_info += ':';
+                        final_vcf_info += qa;
+                    }
+
+                    vcf_line_data.ns++;
+                    if(gt != "0") {
+                        int gt_idx = std::stoi(gt.c_str()) - 1;
+                        if(gt_idx < 0) {
+//                            std::cout << "\t\tNonzero gt" << '\t' << gt_idx << '\t' << final_vcf_info << std::endl;
+                        }
+//                        std::cout << "\t\tgt_idx final: " << gt_idx << std::endl;
+                        vcf_line_data.ac[gt_idx] += 2;
+                        vcf_line_data.nsa++;
+                    }
+                }
+                else {
+//                    std::cout << "\tcheck2 qsize else" << std::endl;
+                    appendNoCall(final_var_info, final_vcf_info, sample_depth, alts_present_at_pos.size());
+                    positional_variants.endField();
+                    vcf_variants.endField();
+                    continue;
+                }
+                positional_variants.endField();
+                vcf_variants.endField();
+            }
+//            std::cout << "\tcheck 7.1" << std::endl;
+            ofs << this_ref << ':' << (j + 1);
+            for(int i = 0; i < _sample_names.size(); ++i) {
+                ofs << '\t' << positional_variants[i];
+            }
+            ofs << std::endl;
+
+            if(position_has_major_variant) {
+                ofs2 << this_ref << ':' << (j + 1);
+                for(int i = 0; i < _sample_names.size(); ++i) {
+                    ofs2 << '\t' << positional_variants[i];
+                }
+                ofs2 << std::endl;
+            }
+
+//            std::cout << "\tcheck 7.2" << std::endl;
+
+            vcf_line_data.qual = std::log((double)vcf_line_data.ao_sum) * (vcf_line_data.qual / (double)vcf_line_data.ao_sum);
+            for(int i = 0; i < vcf_line_data.alt.size(); ++i) {
+                vcf_line_data.af[i] = (double)vcf_line_data.ao[i] / (double)vcf_line_data.dp;
+                vcf_line_data.mqm[i] /= (double)vcf_line_data.ao[i];
+            }
+            vcf_line_data.mqmr /= (double)vcf_line_data.ro;
+
+//            std::cout << "\tcheck 7.3" << std::endl;
+
+            std::chrono::steady_clock::time_point write_start = std::chrono::steady_clock::now();
+            vcf_writer.writeSampleData(vcf_line_data, vcf_variants);
+            vcf_write_ns += std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now()
+                                                                                   - write_start).count();
+
+            num_sites++;
+            long allocations = threadAllocations() - start_allocations;
+            site_allocations += allocations;
+            if(allocations > 0) {
+                num_allocating_sites++;
+                last_allocating_site = num_sites;
+            }
+
+//            std::cout << "\tcheck final" << std::endl;
+        }
+    }
+
+    RunMetrics &metrics = _buffer_q->metrics;
+    metrics.num_positions += num_positions;
+    metrics.num_variant_sites += num_sites;
+    metrics.bytes_written += (long)ofs.tellp() + (long)ofs2.tellp() + vcf_writer.bytesWritten();
+    metrics.addTime(RunMetrics::vcf_write, vcf_write_ns);
+    calling_timer.stop(wait_ns + vcf_write_ns);
+
+    ofs.close();
+    ofs2.close();
+    vcf_writer.close();
+
+    if(allocStatsEnabled()) {
+        // One write so lines from concurrent callers do not interleave
+        std::string report = "Variant calling " + _parent_ref + ": " + std::to_string(num_sites) + " sites, ";
+        report += std::to_string(site_allocations) + " heap allocations, ";
+        report += std::to_string(num_allocating_sites) + " sites allocating, last at site ";
+        report += std::to_string(last_allocating_site) + "\n";
+        std::cerr << report;
+    }
+}
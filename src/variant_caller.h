@@ -0,0 +1,91 @@
+#ifndef SIMPLE_SNP_VARIANT_CALLER_H
+#define SIMPLE_SNP_VARIANT_CALLER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "args.h"
+#include "concurrent_buffer_queue.h"
+#include "fasta_parser.h"
+#include "pileup_spill.h"
+#include "vcf_writer.h"
+#include "genotype_arena.h"
+
+
+// Cohort variant calling for one group of samples that share a parent reference.  Writes the per-sample variant
+// table, the dominant population variant table and the VCF for that group.  Only reads from the buffer queue and
+// FASTA parser, so several callers may run concurrently, and may start while SAM files are still being parsed: each
+// reference is called once the buffer queue reports it complete across the group's samples.  In out-of-core mode
+// each caller streams its samples' spill files block by block instead.
+class VariantCaller {
+public:
+    VariantCaller(Args &args,
+                  ConcurrentBufferQueue* buffer_q,
+                  FastaParser* fasta_parser,
+                  const std::string &parent_ref,
+                  const std::vector< std::string > &sample_names,
+                  const std::vector< std::string > &refs,
+                  const std::string &output_prefix,
+                  const std::string &command_string);
+
+    void run();
+
+private:
+    // One sample's pileup for the current block of positions
+    struct SampleView {
+        const std::vector< PagedArray< int > > *nucl = nullptr;
+        const std::vector< PagedArray< long > > *qual = nullptr;
+        const std::vector< PagedArray< long > > *mapq = nullptr;
+        const IndelTable *ins = nullptr;
+        const IndelTable *del = nullptr;
+    };
+
+    // Scratch of the calling loop, cleared and reused from position to position and site to site, so calling
+    // allocates nothing once the buffers have grown to the widest site.  One per thread, kept between the callers
+    // that run on it.
+    struct CallingContext {
+        // <A, C, G, T>
+        std::vector< long > population_allele_counts;
+        std::unordered_map< int, long > population_insertions;
+        std::unordered_map< int, long > population_deletions;
+
+        vcfLineData vcf_line_data;
+        std::string alts_present_at_pos;
+
+        // Alleles called in the current sample, < frequency, allele info >; the first num_alleles are in use
+        std::vector< std::pair< double, std::string > > alleles;
+        int num_alleles = 0;
+        std::vector< int > sample_vcf_ao;
+        std::vector< double > sample_vcf_qa;
+
+        // Genotype fields of each sample at the current site, in output column order
+        GenotypeArena positional_variants;
+        GenotypeArena vcf_variants;
+    };
+
+    void _loadBlock(const int &ref_idx, const long &start, const long &stop);
+
+    Args& _args;
+    ConcurrentBufferQueue* _buffer_q;
+    FastaParser* _fasta_parser;
+    std::string _parent_ref;
+    std::vector< std::string > _sample_names;
+    std::vector< std::string > _refs;
+    std::string _output_prefix;
+    std::string _command_string;
+
+    // Buffer queue ids: parent reference, and parallel to _refs and _sample_names
+    int _parent_ref_id;
+    std::vector< int > _ref_ids;
+    std::vector< int > _sample_ids;
+
+    // Parallel to _sample_names
+    std::vector< SampleView > _views;
+    std::vector< PileupBlock > _blocks;
+    // { spill path : reader }, out-of-core mode only
+    std::unordered_map< std::string, std::unique_ptr< PileupSpillReader > > _spill_readers;
+};
+
+
+#endif //SIMPLE_SNP_VARIANT_CALLER_H
@@ -3,6 +3,20 @@
 #include <cassert>
 
 
+void vcfLineData::clear()
+{
+    alt.clear();
+    alt_ns.clear();
+    ac.clear();
+    af.clear();
+    ao.clear();
+    mqm.clear();
+    gq.clear();
+    type.clear();
+    cigar.clear();
+}
+
+
 VcfWriter::VcfWriter(std::string &vcf_path) : _vcf_path(vcf_path)
 {
 
@@ -72,7 +86,7 @@ void VcfWriter::writeSamples(const std::vector< std::string > &samplenames)
 
 
 void VcfWriter::writeSampleData(const vcfLineData &vcf_line_data,
-                                const std::map< std::string, std::string > &vcf_variants)
+                                const GenotypeArena &vcf_variants)
 {
     _ofs << vcf_line_data.chrom;
     _ofs << '\t' << std::to_string(vcf_line_data.pos);
@@ -111,7 +125,7 @@ void VcfWriter::writeSampleData(const vcfLineData &vcf_line_data,
     _ofs << "TYPE=snp\t";
     _ofs << "GT:DP:AD:RO:QR:AO:QA";
     for(int i = 0; i < _sample_order.size(); ++i) {
-        _ofs << '\t' << vcf_variants.at(_sample_order[i]);
+        _ofs << '\t' << vcf_variants[i];
     }
     _ofs << std::endl;
 }
@@ -130,3 +144,9 @@ void VcfWriter::close()
 {
     _ofs.close();
 }
+
+
+long VcfWriter::bytesWritten()
+{
+    return _ofs.tellp();
+}
@@ -6,12 +6,16 @@
 #include <vector>
 #include <map>
 #include <fstream>
+#include "genotype_arena.h"
 
 
 typedef std::chrono::system_clock Clock;
 
 
 struct vcfLineData {
+    // Empty the per-allele vectors for the next site, keeping their capacity
+    void clear();
+
     std::string chrom;
     std::string ref;
     std::vector< std::string > alt;
@@ -43,11 +47,15 @@ public:
                       const std::vector< std::string > &contig_names,
                       const std::vector< long > &contig_lens);
     void writeSamples(const std::vector< std::string > &samplenames);
+    // vcf_variants holds each sample's genotype fields, in the order given to writeSamples()
     void writeSampleData(const vcfLineData &vcf_line_data,
-                         const std::map< std::string, std::string > &vcf_variants);
+                         const GenotypeArena &vcf_variants);
     void open();
     void close();
 
+    // Bytes written so far
+    long bytesWritten();
+
 private:
     std::string _vcf_path;
     std::ofstream _ofs;